@@ -0,0 +1,105 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <unistd.h>
+#include <malloc.h>
+#include "system.hpp"
+#include "bench_support.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Counts heap allocations on the hot paths that should not need any per
+// event: browsing the schedule, and saving when nothing or a little changed.
+// Also reports what an event record takes, inline and on the heap.
+// Point it at a directory made by workload_gen; it rewrites the files there.
+//
+// usage: ./bench_alloc <data_dir>
+
+static atomic<long long> allocations{0};
+static atomic<long long> heap_bytes{0}; // live, as malloc rounds them up
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) {
+        heap_bytes.fetch_add(malloc_usable_size(p), memory_order_relaxed);
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    heap_bytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    heap_bytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+    free(p);
+}
+
+// bytes per event of a copy of events, on the heap including the vector itself
+static double bytes_per_event(const vector<Event>& events) {
+    long long before = heap_bytes.load();
+    vector<Event> copy(events);
+    return (double)(heap_bytes.load() - before) / max<size_t>(events.size(), 1);
+}
+
+template <typename F>
+static void measure(const char* what, size_t events, F f) {
+    long long before = allocations.load();
+    auto start = steady_clock::now();
+    f();
+    long long elapsed = duration_cast<microseconds>(steady_clock::now() - start).count();
+    long long count = allocations.load() - before;
+    cerr << what << ": " << count << " allocations (" << (double)count / max<size_t>(events, 1)
+         << " per event), " << elapsed << " us\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <data_dir>\n";
+        return 1;
+    }
+    if (chdir(argv[1]) != 0) {
+        cerr << "cannot enter " << argv[1] << "\n";
+        return 1;
+    }
+    NullBuffer null_buffer;
+    streambuf* old = cout.rdbuf(&null_buffer);
+    {
+        System system;
+        size_t events = system.get_facility().get_events().size();
+        cerr << events << " events, " << system.get_users().size() << " users\n";
+
+        User* buyer = system.get_users().by_name().front();
+        measure("browse events", events, [&] { system.browse_events(buyer); });
+        string cursor = system.browse_events_page(buyer, BY_NAME, 20, "");
+        measure("browse, page 2 of 20 by name", events, [&] { system.browse_events_page(buyer, BY_NAME, 20, cursor); });
+        measure("save, nothing changed", events, [&] { system.save(); });
+        measure("save again", events, [&] { system.save(); });
+
+        for (const Event& event : system.get_facility().get_events()) {
+            if (event.is_public() && event.is_confirmed()) {
+                system.buy_ticket(buyer, event.get_name());
+                break;
+            }
+        }
+        measure("save, one ticket sold", events, [&] { system.save(); });
+
+        // tickets still unparsed, then with every event's tickets parsed
+        vector<Event>& all = system.get_facility().get_events();
+        vector<Event> private_only;
+        copy_if(all.begin(), all.end(), back_inserter(private_only), [](const Event& event) { return !event.is_public(); });
+        cerr << "event record: " << sizeof(Event) << " bytes inline; " << bytes_per_event(all) << " bytes per event as loaded, "
+             << bytes_per_event(private_only) << " per private event (" << private_only.size() << ")\n";
+        for (const Event& event : all) {
+            event.tickets_left();
+        }
+        cerr << "with tickets parsed: " << bytes_per_event(all) << " bytes per event\n";
+    }
+    cout.rdbuf(old);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <unistd.h>
+#include "system.hpp"
+#include "bench_support.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Many buyers going for one hot event at once. Runs the same crowd twice, on
+// the two public events with the most seats left: first buying one by one
+// under the System lock, then through on-sale mode, where buyers queue
+// without the lock and whoever gets it settles everyone queued so far.
+// Point it at a directory made by workload_gen; it saves the sales there.
+//
+// usage: ./bench_onsale <data_dir> [buyers] [threads]
+
+struct RunResult {
+    vector<long long> latencies_ns;
+    int bought = 0;
+};
+
+// buyers are split over the threads; buy returns whether the buyer got a ticket
+template <typename F>
+static void run(const char* mode, const vector<User*>& buyers, int num_threads, F buy) {
+    vector<RunResult> results(num_threads);
+    vector<thread> threads;
+    auto begin = steady_clock::now();
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < buyers.size(); i += num_threads) {
+                auto start = steady_clock::now();
+                results[t].bought += buy(buyers[i]);
+                results[t].latencies_ns.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed_s = duration_cast<microseconds>(steady_clock::now() - begin).count() / 1e6;
+
+    vector<long long> all;
+    int bought = 0;
+    for (const RunResult& result : results) {
+        all.insert(all.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+        bought += result.bought;
+    }
+    sort(all.begin(), all.end());
+    cerr << left << setw(10) << mode << right << setw(10) << all.size() << setw(10) << bought
+        << setw(12) << fixed << setprecision(0) << all.size() / elapsed_s << setprecision(1)
+        << setw(12) << percentile_us(all, 0.50) << setw(12) << percentile_us(all, 0.99)
+        << setw(12) << (all.empty() ? 0 : all.back() / 1000.0) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <data_dir> [buyers] [threads]\n";
+        return 1;
+    }
+    int num_buyers = argc > 2 ? stoi(argv[2]) : 5000;
+    int num_threads = argc > 3 ? stoi(argv[3]) : 8;
+    if (chdir(argv[1]) != 0) {
+        cerr << "cannot enter data directory " << argv[1] << "\n";
+        return 1;
+    }
+
+    // the System entry points talk to the terminal, keep that out of the report
+    NullBuffer discard;
+    streambuf* console = cout.rdbuf(&discard);
+    unique_ptr<System> system(new System());
+
+    vector<User*> buyers;
+    for (User* user : system->get_users().by_name()) {
+        buyers.push_back(user);
+    }
+    Facility& facility = system->get_facility();
+    vector<size_t> hot = facility.query(EventQuery().public_events().open_to_non().confirmed().with_tickets_left(1));
+    if (buyers.empty() || hot.size() < 2) {
+        cout.rdbuf(console);
+        cerr << "need users and two public events with seats left in " << argv[1] << ", run workload_gen first\n";
+        return 1;
+    }
+    sort(hot.begin(), hot.end(), [&](size_t a, size_t b) {
+        return facility.get_events()[a].tickets_left() > facility.get_events()[b].tickets_left();
+    });
+    string direct_event = facility.get_events()[hot[0]].get_name();
+    string sale_event = facility.get_events()[hot[1]].get_name();
+    cerr << num_buyers << " buyers on " << num_threads << " threads; seats left: "
+        << facility.get_events()[hot[0]].tickets_left() << " direct, " << facility.get_events()[hot[1]].tickets_left() << " on sale\n\n";
+    vector<User*> crowd;
+    for (int i = 0; i < num_buyers; i++) {
+        crowd.push_back(buyers[i % buyers.size()]);
+    }
+
+    cerr << left << setw(10) << "mode" << right << setw(10) << "requests" << setw(10) << "bought"
+        << setw(12) << "req/s" << setw(12) << "p50(us)" << setw(12) << "p99(us)" << setw(12) << "max(us)" << "\n";
+    run("direct", crowd, num_threads, [&](User* user) {
+        lock_guard<mutex> guard(system_lock);
+        return system->buy_ticket(user, direct_event);
+    });
+
+    system->open_sale(sale_event);
+    OnSale* sale = system->on_sale(sale_event);
+    run("on-sale", crowd, num_threads, [&](User* user) {
+        future<SaleOutcome> outcome = sale->submit(user, 1);
+        while (outcome.wait_for(seconds(0)) != future_status::ready) {
+            if (system_lock.try_lock()) {
+                system->settle_sales();
+                system_lock.unlock();
+            } else {
+                this_thread::yield();
+            }
+        }
+        return outcome.get() == SALE_BOUGHT;
+    });
+    system->close_sale(sale_event);
+
+    system.reset();
+    cout.rdbuf(console);
+    return 0;
+}
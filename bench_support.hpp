@@ -0,0 +1,32 @@
+#ifndef BENCH_SUPPORT_HPP
+#define BENCH_SUPPORT_HPP
+
+#include <streambuf>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+using namespace std;
+
+// Shared by the load and benchmark tools.
+
+// swallows everything written to it
+struct NullBuffer : streambuf {
+    int overflow(int c) override {
+        return c;
+    }
+};
+
+// System is not thread safe; a tool's client threads take turns with it through
+// this lock, except for what the tool documents as running outside it
+inline mutex system_lock;
+
+// the latency at fraction p of sorted nanoseconds, in microseconds
+inline double percentile_us(const vector<long long>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.0;
+}
+
+#endif // BENCH_SUPPORT_HPP
@@ -0,0 +1,90 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include "user_registry.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Logins, balance checks and sign-ups from many threads at once: a map behind
+// one lock, the way System kept its users, against the sharded UserRegistry.
+// Each operation is a login by name followed by a balance check; one in
+// create_every creates a new user instead.
+//
+// usage: ./bench_users [users] [threads] [ops_per_thread] [create_every]
+
+// the old layout: every lookup walks one tree, under one lock
+class LockedMap {
+    map<string, User> users;
+    mutex lock;
+
+public:
+    User* find(const string& name) {
+        lock_guard<mutex> guard(lock);
+        auto it = users.find(name);
+        return it == users.end() ? nullptr : &it->second;
+    }
+
+    void create(const string& name, double balance, USER_TYPE type) {
+        lock_guard<mutex> guard(lock);
+        users.emplace(piecewise_construct, forward_as_tuple(name), forward_as_tuple(name, balance, type));
+    }
+};
+
+template <typename Users>
+static void run(const char* name, Users& users, int num_users, int num_threads, int ops, int create_every) {
+    for (int i = 0; i < num_users; i++) {
+        users.create("user" + to_string(i), 100, RESIDENT);
+    }
+    vector<thread> threads;
+    vector<double> seen(num_threads);
+    auto begin = steady_clock::now();
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            mt19937 rng(t);
+            double total = 0;
+            for (int i = 0; i < ops; i++) {
+                if (create_every > 0 && i % create_every == 0) {
+                    users.create("new" + to_string(t) + "_" + to_string(i), 100, NON_RESIDENT);
+                    continue;
+                }
+                if (User* user = users.find("user" + to_string(rng() % num_users))) {
+                    total += user->get_bank_balance();
+                }
+            }
+            seen[t] = total;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed_s = duration_cast<microseconds>(steady_clock::now() - begin).count() / 1e6;
+    cerr << left << setw(12) << name << right << setw(12) << fixed << setprecision(0)
+         << (double)num_threads * ops / elapsed_s << setw(12) << setprecision(3) << elapsed_s << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    int num_users = argc > 1 ? stoi(argv[1]) : 100000;
+    int num_threads = argc > 2 ? stoi(argv[2]) : 8;
+    int ops = argc > 3 ? stoi(argv[3]) : 500000;
+    int create_every = argc > 4 ? stoi(argv[4]) : 100;
+
+    cerr << num_users << " users, " << num_threads << " threads, " << ops << " ops each, a sign-up every "
+         << create_every << "\n\n";
+    cerr << left << setw(12) << "registry" << right << setw(12) << "ops/s" << setw(12) << "seconds" << "\n";
+    {
+        LockedMap users;
+        run("locked map", users, num_users, num_threads, ops, create_every);
+    }
+    {
+        UserRegistry users;
+        run("sharded", users, num_users, num_threads, ops, create_every);
+    }
+    return 0;
+}
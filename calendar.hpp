@@ -0,0 +1,202 @@
+#ifndef CALENDAR_HPP
+#define CALENDAR_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include <charconv>
+
+using namespace std;
+using namespace std::chrono;
+
+// a local date and time of day, as on the facility's wall clock
+struct CivilTime {
+    int year;
+    int month; // 1-12
+    int day;   // 1-31
+    int hour;
+    int minute;
+    int second;
+
+    // YYYYMMDD, sorts like the date
+    long long ymd() const {
+        return year * 10000LL + month * 100 + day;
+    }
+};
+
+// a CivilTime on its way to a stream; the text is built on the stack
+struct CivilFormat {
+    enum Kind { YMD, MDY, HM };
+    CivilTime time;
+    Kind kind;
+};
+
+inline ostream& operator<<(ostream& out, const CivilFormat& f) {
+    char text[16];
+    const CivilTime& c = f.time;
+    int n = f.kind == CivilFormat::YMD ? snprintf(text, sizeof(text), "%04d-%02d-%02d", c.year, c.month, c.day)
+        : f.kind == CivilFormat::MDY   ? snprintf(text, sizeof(text), "%02d-%02d-%04d", c.month, c.day, c.year)
+                                       : snprintf(text, sizeof(text), "%02d:%02d", c.hour, c.minute);
+    return out.write(text, n);
+}
+
+// Local calendar arithmetic for the validation, grouping and formatting paths.
+// localtime() shares one static buffer between threads and looks the timezone
+// up on every call, and mktime() is no better. Instead the UTC offsets of the
+// local timezone are read once into a table of transitions, and converting is
+// a binary search plus the days_from_civil / civil_from_days arithmetic.
+// Lookups are thread-safe and do not allocate. TZ is read on first use.
+class Calendar {
+    static const int64_t SECONDS_PER_DAY = 86400;
+    static const int64_t TABLE_FROM = 0;                   // 1970-01-01
+    static const int64_t TABLE_TO = 4102444800;            // 2100-01-01
+    static const int64_t PROBE_STEP = 7 * SECONDS_PER_DAY; // timezones change at most a few times a year
+
+    vector<int64_t> changes_at; // UTC second each offset takes effect, ascending
+    vector<int32_t> offsets;    // seconds east of UTC from changes_at[i] on
+
+    static int32_t offset_from_libc(int64_t utc) {
+        time_t t = utc;
+        tm local;
+        localtime_r(&t, &local);
+        return (int32_t)local.tm_gmtoff;
+    }
+
+    // probes weekly and finds each change to the second
+    Calendar() {
+        changes_at.push_back(INT64_MIN);
+        offsets.push_back(offset_from_libc(TABLE_FROM));
+        for (int64_t t = TABLE_FROM; t < TABLE_TO; t += PROBE_STEP) {
+            int32_t next = offset_from_libc(t + PROBE_STEP);
+            if (next == offsets.back()) {
+                continue;
+            }
+            int64_t lo = t, hi = t + PROBE_STEP; // offset differs at hi, not at lo
+            while (hi - lo > 1) {
+                int64_t mid = lo + (hi - lo) / 2;
+                (offset_from_libc(mid) == offsets.back() ? lo : hi) = mid;
+            }
+            changes_at.push_back(hi);
+            offsets.push_back(next);
+        }
+    }
+
+    static const Calendar& table() {
+        static const Calendar calendar; // built once, thread-safe since C++11
+        return calendar;
+    }
+
+    static int64_t floor_div(int64_t a, int64_t b) {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+public:
+    // days since 1970-01-01 of a proleptic Gregorian date
+    static constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const int64_t era = (y >= 0 ? y : y - 399) / 400;
+        const unsigned yoe = (unsigned)(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int64_t)doe - 719468;
+    }
+
+    // inverse of days_from_civil
+    static constexpr void civil_from_days(int64_t z, int& year, int& month, int& day) {
+        z += 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = (unsigned)(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        day = (int)(doy - (153 * mp + 2) / 5 + 1);
+        month = (int)(mp < 10 ? mp + 3 : mp - 9);
+        year = (int)(yoe + era * 400 + (month <= 2));
+    }
+
+    // seconds east of UTC at a UTC instant
+    static int32_t utc_offset(int64_t utc) {
+        const Calendar& c = table();
+        size_t i = upper_bound(c.changes_at.begin(), c.changes_at.end(), utc) - c.changes_at.begin() - 1;
+        return c.offsets[i];
+    }
+
+    static int64_t to_seconds(const time_point<system_clock>& t) {
+        return duration_cast<seconds>(t.time_since_epoch()).count();
+    }
+
+    // local day number: days since 1970-01-01 on the local calendar
+    static int64_t local_day(int64_t utc) {
+        return floor_div(utc + utc_offset(utc), SECONDS_PER_DAY);
+    }
+
+    static int64_t local_day(const time_point<system_clock>& t) {
+        return local_day(to_seconds(t));
+    }
+
+    static CivilTime local(int64_t utc) {
+        int64_t local_seconds = utc + utc_offset(utc);
+        int64_t days = floor_div(local_seconds, SECONDS_PER_DAY);
+        int64_t of_day = local_seconds - days * SECONDS_PER_DAY;
+        CivilTime civil;
+        civil_from_days(days, civil.year, civil.month, civil.day);
+        civil.hour = (int)(of_day / 3600);
+        civil.minute = (int)(of_day / 60 % 60);
+        civil.second = (int)(of_day % 60);
+        return civil;
+    }
+
+    static CivilTime local(const time_point<system_clock>& t) {
+        return local(to_seconds(t));
+    }
+
+    // The UTC instant of a local wall-clock time. A time in the hour clocks go back
+    // takes the earlier instant, where glibc's mktime picks either depending on its
+    // previous calls; a time skipped when they go forward is read with the old offset.
+    static int64_t to_utc(int year, int month, int day, int hour = 0, int minute = 0, int second = 0) {
+        int64_t local_seconds = days_from_civil(year, month, day) * SECONDS_PER_DAY + hour * 3600LL + minute * 60LL + second;
+        int32_t before = utc_offset(local_seconds - SECONDS_PER_DAY);
+        int32_t after = utc_offset(local_seconds + SECONDS_PER_DAY);
+        bool before_valid = utc_offset(local_seconds - before) == before;
+        bool after_valid = utc_offset(local_seconds - after) == after;
+        if (after_valid && (!before_valid || local_seconds - after < local_seconds - before)) {
+            return local_seconds - after;
+        }
+        return local_seconds - before;
+    }
+
+    // MM-DD-YYYY as users type dates, single digit months and days too; false if it is not one
+    static bool parse_mdy(string_view text, int& year, int& month, int& day) {
+        int* fields[] = {&month, &day, &year};
+        const char* p = text.data();
+        const char* end = p + text.size();
+        for (int i = 0; i < 3; i++) {
+            auto parsed = from_chars(p, end, *fields[i]);
+            if (parsed.ec != errc() || (i < 2 && (parsed.ptr == end || *parsed.ptr != '-'))) {
+                return false;
+            }
+            p = parsed.ptr + (i < 2);
+        }
+        return p == end && month >= 1 && month <= 12 && day >= 1 && day <= 31;
+    }
+
+    // stream manipulators for the formats the menus print, e.g. cout << Calendar::mdy(civil)
+    static CivilFormat ymd(const CivilTime& c) { // YYYY-MM-DD
+        return {c, CivilFormat::YMD};
+    }
+
+    static CivilFormat mdy(const CivilTime& c) { // MM-DD-YYYY
+        return {c, CivilFormat::MDY};
+    }
+
+    static CivilFormat hm(const CivilTime& c) { // HH:MM
+        return {c, CivilFormat::HM};
+    }
+};
+
+#endif // CALENDAR_HPP
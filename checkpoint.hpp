@@ -0,0 +1,144 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <chrono>
+#include <vector>
+#include <dirent.h>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// Decides when System saves in the background and runs the save in a forked
+// child. fork() hands the child a copy-on-write snapshot of users, events,
+// tickets, waitlists and the budget, so the foreground only pays for the fork
+// itself while the child merges and writes the files. One checkpoint runs at
+// a time; a crash loses at most what changed since the last one finished.
+// The child's exit status says whether it saved; see failed().
+// Only a single-threaded process forks: the child of a threaded one would have
+// just the forking thread, and a lock another thread held at the fork (the
+// heap's, a UserRegistry shard's) would never be released in it. The child
+// closes the descriptors it inherited, so a server's sockets stay the server's.
+class Checkpointer {
+    int every_mutations;
+    seconds every;
+    int mutations = 0;
+    steady_clock::time_point last;
+    pid_t child = -1;
+    bool child_failed = false;
+
+    // forgets the child once it has exited, noting whether it saved; blocks for it if asked to
+    void reap(bool block) {
+        int status = 0;
+        if (child > 0 && waitpid(child, &status, block ? 0 : WNOHANG) != 0) {
+            child_failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            child = -1;
+        }
+    }
+
+    // threads in this process, 0 if /proc cannot tell
+    static int thread_count() {
+        DIR* dir = opendir("/proc/self/task");
+        if (!dir) {
+            return 0;
+        }
+        int count = 0;
+        while (dirent* entry = readdir(dir)) {
+            count += entry->d_name[0] != '.';
+        }
+        closedir(dir);
+        return count;
+    }
+
+    // every descriptor but stdin, stdout and stderr
+    static void close_inherited_fds() {
+        vector<int> fds;
+        if (DIR* dir = opendir("/proc/self/fd")) {
+            while (dirent* entry = readdir(dir)) {
+                int fd = atoi(entry->d_name);
+                if (fd > 2 && fd != dirfd(dir)) {
+                    fds.push_back(fd);
+                }
+            }
+            closedir(dir);
+        }
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+
+public:
+    static const int DEFAULT_MUTATIONS = 100;
+    static constexpr seconds DEFAULT_INTERVAL{30};
+
+    Checkpointer(int every_mutations = DEFAULT_MUTATIONS, seconds every = DEFAULT_INTERVAL)
+        : every_mutations(every_mutations), every(every), last(steady_clock::now()) {}
+
+    ~Checkpointer() {
+        wait();
+    }
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    void mutated() {
+        mutations++;
+    }
+
+    // there are unsaved changes, enough of them or old enough, and no checkpoint is running
+    bool due() {
+        reap(false);
+        return child < 0 && mutations > 0 && (mutations >= every_mutations || steady_clock::now() - last >= every);
+    }
+
+    // Runs save in a child process. False if this process has other threads or fork
+    // fails; the caller saves in the foreground then, and calls saved().
+    template <typename F>
+    bool start(F save) {
+        if (thread_count() != 1) {
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close_inherited_fds();
+            try {
+                save();
+            } catch (...) {
+                _exit(1);
+            }
+            _exit(0); // skip the parent's destructors, they would save again
+        }
+        if (pid < 0) {
+            return false;
+        }
+        child = pid;
+        saved();
+        return true;
+    }
+
+    // the changes so far are on disk
+    void saved() {
+        mutations = 0;
+        last = steady_clock::now();
+    }
+
+    // Whether a checkpoint failed since the last call. Its writes only show once it has
+    // made all of them, so one that failed wrote nothing: the changes are still unsaved,
+    // and the merge base the process has is still the one to save against.
+    bool failed() {
+        reap(false);
+        bool failed = child_failed;
+        child_failed = false;
+        return failed;
+    }
+
+    // until the running checkpoint, if any, has finished
+    void wait() {
+        reap(true);
+    }
+};
+
+#endif // CHECKPOINT_HPP
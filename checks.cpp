@@ -0,0 +1,829 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <ctime>
+#include <sys/stat.h>
+#include "calendar.hpp"
+#include "seat_map.hpp"
+#include "timing_wheel.hpp"
+#include "rcu.hpp"
+#include "name_index.hpp"
+#include "money.hpp"
+#include "schedule.hpp"
+#include "store.hpp"
+#include "checkpoint.hpp"
+#include "system.hpp"
+#include "bench_support.hpp"
+
+using namespace std;
+
+// Randomized checks of the indexes, lists, clocks and prices against the slow, obvious way of
+// getting the same answer. Each check prints ok or what went wrong; the exit
+// status is the number that failed. Calendar checks the timezone in TZ, so
+// `make check` runs this under a few of them.
+//
+// usage: ./checks [seed]
+
+static int failures = 0;
+
+static void report(const string& name, long bad, const string& detail = "") {
+    cout << name << ": " << (bad == 0 ? "ok" : "FAILED, " + to_string(bad) + " wrong") << (detail.empty() ? "" : " (" + detail + ")") << "\n";
+    failures += bad != 0;
+}
+
+// local() against localtime_r, and to_utc() back from local(): the same instant,
+// or an earlier one with the same wall clock when clocks went back
+static void check_calendar(mt19937_64& rng) {
+    long bad = 0;
+    for (int i = 0; i < 300000; i++) {
+        int64_t t = (int64_t)(rng() % 4102444800ULL); // 1970 to 2100
+        time_t libc_t = t;
+        tm expected;
+        localtime_r(&libc_t, &expected);
+        CivilTime c = Calendar::local(t);
+        if (c.year != expected.tm_year + 1900 || c.month != expected.tm_mon + 1 || c.day != expected.tm_mday
+            || c.hour != expected.tm_hour || c.minute != expected.tm_min || c.second != expected.tm_sec) {
+            bad++;
+            continue;
+        }
+        int64_t back = Calendar::to_utc(c.year, c.month, c.day, c.hour, c.minute, c.second);
+        CivilTime again = Calendar::local(back);
+        if (back > t || again.ymd() != c.ymd() || again.hour != c.hour || again.minute != c.minute || again.second != c.second) {
+            bad++;
+        }
+    }
+    const char* tz = getenv("TZ");
+    report("Calendar::local/to_utc", bad, string("TZ=") + (tz ? tz : ""));
+}
+
+// best_block() against scanning the rows seat by seat
+static void check_seat_map(mt19937_64& rng) {
+    long bad = 0;
+    for (int style = 0; style < 4; style++) {
+        const SeatLayout& layout = SeatLayout::of(style);
+        SeatMap seats(layout);
+        vector<bool> free(layout.get_capacity(), true);
+        for (int i = 0; i < 100000; i++) {
+            int seat = rng() % layout.get_capacity();
+            if (rng() % 2) {
+                seats.take(seat);
+                free[seat] = false;
+            } else {
+                seats.release(seat);
+                free[seat] = true;
+            }
+            int count = 1 + rng() % 10;
+            int expected = -1;
+            for (const SeatLayout::Row& row : layout.get_rows()) {
+                for (int first = row.first; expected < 0 && first + count <= row.first + row.seats; first++) {
+                    bool all_free = true;
+                    for (int s = first; s < first + count; s++) {
+                        all_free &= free[s];
+                    }
+                    if (all_free) {
+                        expected = first;
+                    }
+                }
+                if (expected >= 0) {
+                    break;
+                }
+            }
+            bad += seats.best_block(count) != expected;
+        }
+    }
+    report("SeatMap::best_block", bad);
+}
+
+// advance() against a sorted map of deadlines: each step fires exactly the
+// timers due by then, including ones added overdue and ones added while firing
+static void check_timing_wheel(mt19937_64& rng) {
+    int64_t now = 1700000000;
+    TimingWheel<int> wheel(now);
+    multimap<int64_t, int> pending;
+    int next_id = 0;
+    long bad = 0;
+    auto add = [&](int64_t due) {
+        wheel.add(due, next_id);
+        pending.emplace(due, next_id++);
+    };
+    for (int step = 0; step < 100000; step++) {
+        for (int n = rng() % 3; n > 0; n--) {
+            int kind = rng() % 10;
+            int64_t spread = kind < 4 ? 100 : kind < 7 ? 100000 : kind < 9 ? 100000000 : -1000;
+            int64_t due = spread > 0 ? now + (int64_t)(rng() % spread) : now - (int64_t)(rng() % 1000);
+            if (rng() % 1000 == 0) {
+                due = now + (int64_t)(rng() % 3000000000LL); // past the top level
+            }
+            add(due);
+        }
+        now += rng() % 4 == 0 ? (int64_t)(rng() % 1000000) : (int64_t)(rng() % 200);
+        vector<int> fired;
+        wheel.advance(now, [&](int id) {
+            fired.push_back(id);
+            if (id % 7 == 0) { // reschedules, sometimes already due
+                add(now - 5 + (int64_t)(rng() % 10));
+            }
+        });
+        vector<int> expected;
+        for (auto it = pending.begin(); it != pending.end() && it->first <= now; it = pending.erase(it)) {
+            expected.push_back(it->second);
+        }
+        sort(fired.begin(), fired.end());
+        sort(expected.begin(), expected.end());
+        bad += fired != expected || wheel.size() != pending.size();
+    }
+    report("TimingWheel::advance", bad);
+}
+
+// Staged writes show all at once or not at all, and a checkpoint child that
+// fails is reported once, one that saves is not
+static void check_checkpoint() {
+    long bad = 0;
+    char dir[] = "/tmp/checksXXXXXX";
+    if (!mkdtemp(dir)) {
+        report("Checkpoint", 1, "no temp dir");
+        return;
+    }
+    string a = string(dir) + "/a", b = string(dir) + "/b", log = string(dir) + "/log";
+    write_file_atomically(a, "old");
+    string content;
+    {
+        StagedWrites staged;
+        write_file_atomically(a, "new");
+        append_to_file(log, "line\n");
+        bad += !read_file(a, content) || content != "old" || read_file(log, content);
+        bad += !staged.commit();
+    }
+    bad += !read_file(a, content) || content != "new" || !read_file(log, content) || content != "line\n";
+    {
+        StagedWrites staged;
+        write_file_atomically(a, "newer");
+        write_file_atomically(string(dir) + "/missing/b", "x"); // no such directory
+        bad += staged.commit();
+    }
+    bad += !read_file(a, content) || content != "new" || read_file(b, content);
+
+    Checkpointer checkpointer(1);
+    checkpointer.mutated();
+    bad += !checkpointer.due() || !checkpointer.start([] { throw runtime_error("disk full"); });
+    checkpointer.wait();
+    bad += !checkpointer.failed() || checkpointer.failed();
+    checkpointer.mutated();
+    bad += !checkpointer.due() || !checkpointer.start([] {});
+    checkpointer.wait();
+    bad += checkpointer.failed();
+
+    remove(a.c_str());
+    remove(log.c_str());
+    rmdir(dir);
+    report("Checkpoint failure", bad);
+}
+
+// a version that knows whether it has been freed
+struct Version {
+    static mutex lock;
+    static set<int> alive;
+    int id;
+
+    explicit Version(int id) : id(id) {
+        lock_guard<mutex> guard(lock);
+        alive.insert(id);
+    }
+
+    ~Version() {
+        lock_guard<mutex> guard(lock);
+        alive.erase(id);
+    }
+
+    static bool is_alive(int id) {
+        lock_guard<mutex> guard(lock);
+        return alive.count(id) > 0;
+    }
+
+    static size_t count() {
+        lock_guard<mutex> guard(lock);
+        return alive.size();
+    }
+};
+
+mutex Version::lock;
+set<int> Version::alive;
+
+// readers never see a freed version, one held across many publishes included,
+// and once nobody reads, a couple of publishes free all but the latest
+static void check_rcu() {
+    long bad = 0;
+    {
+        Rcu<Version> rcu;
+        rcu.publish(make_unique<Version>(0));
+        atomic<bool> done{false};
+        atomic<long> freed_while_read{0};
+        vector<thread> readers;
+        for (int r = 0; r < 4; r++) {
+            readers.emplace_back([&, r] {
+                while (!done.load()) {
+                    Rcu<Version>::Reader reader(rcu);
+                    int id = reader->id;
+                    if (r == 0) {
+                        this_thread::sleep_for(chrono::milliseconds(1)); // pinned across publishes
+                    }
+                    freed_while_read += !Version::is_alive(id) || reader->id != id;
+                }
+            });
+        }
+        int id = 1;
+        for (; id < 20000; id++) {
+            rcu.publish(make_unique<Version>(id));
+        }
+        done = true;
+        for (thread& reader : readers) {
+            reader.join();
+        }
+        bad += freed_while_read.load();
+        rcu.publish(make_unique<Version>(id++));
+        rcu.publish(make_unique<Version>(id++));
+        bad += Version::count() > 2; // the current one and one retired in the last phase
+        Rcu<Version>::Reader reader(rcu);
+        bad += reader->id != id - 1;
+    }
+    bad += Version::count() != 0;
+    report("Rcu reclamation", bad);
+}
+
+// folded, for comparing the way NameIndex does
+static string fold(const string& text) {
+    string folded;
+    for (char c : text) {
+        folded += (char)tolower((unsigned char)c);
+    }
+    return folded;
+}
+
+// edits from text to the closest start of name
+static int prefix_distance(const string& text, const string& name) {
+    vector<int> row(text.size() + 1);
+    for (size_t j = 0; j <= text.size(); j++) {
+        row[j] = j;
+    }
+    int best = row[text.size()];
+    for (size_t i = 1; i <= name.size(); i++) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= text.size(); j++) {
+            int above = row[j];
+            row[j] = min({above + 1, row[j - 1] + 1, diagonal + (text[j - 1] != name[i - 1])});
+            diagonal = above;
+        }
+        best = min(best, row[text.size()]);
+    }
+    return best;
+}
+
+// match() against measuring every name: within the bound for the text's length,
+// closest first, then in name order, each name once, limit of those allowed;
+// contains() only for a name as it was inserted
+static void check_name_index(mt19937_64& rng) {
+    const string letters = "abcAB d";
+    auto random_name = [&](size_t most) {
+        string name;
+        for (size_t n = 1 + rng() % most; n > 0; n--) {
+            name += letters[rng() % letters.size()];
+        }
+        return name;
+    };
+    NameIndex index;
+    multiset<string> names;
+    long bad = 0;
+    for (int i = 0; i < 20000; i++) {
+        if (names.empty() || rng() % 3) {
+            string name = random_name(10);
+            index.insert(name);
+            names.insert(name);
+        } else {
+            auto it = names.begin();
+            advance(it, rng() % names.size());
+            index.erase(*it);
+            names.erase(it);
+        }
+        if (i % 10 != 0) {
+            continue;
+        }
+        string typed = rng() % 2 && !names.empty() ? *names.begin() : random_name(9);
+        if (rng() % 2 && !typed.empty()) {
+            typed[rng() % typed.size()] = letters[rng() % letters.size()];
+        }
+        string text = fold(typed);
+        int max_edits = text.size() < 4 ? 0 : text.size() < 8 ? 1 : 2;
+        size_t limit = 1 + rng() % 10;
+        bool filtered = rng() % 2;
+        auto allowed = [](const string& name) { return name.size() % 2 == 0; };
+
+        vector<tuple<int, string, string>> ranked; // distance, folded name, name
+        for (const string& name : set<string>(names.begin(), names.end())) {
+            int distance = prefix_distance(text, fold(name));
+            if (distance <= max_edits && (!filtered || allowed(name))) {
+                ranked.emplace_back(distance, fold(name), name);
+            }
+        }
+        sort(ranked.begin(), ranked.end());
+        ranked.resize(min(ranked.size(), limit));
+
+        vector<NameMatch> found = filtered ? index.match(typed, limit, allowed) : index.match(typed, limit);
+        bool same = found.size() == ranked.size();
+        for (size_t j = 0; same && j < found.size(); j++) {
+            same = found[j].name == get<2>(ranked[j]) && found[j].distance == get<0>(ranked[j]);
+        }
+        bad += !same || index.size() != names.size() || index.contains(typed) != (names.count(typed) > 0);
+    }
+    report("NameIndex::match", bad);
+}
+
+// SharedSortedList against a sorted set, through enough inserts and erases to
+// split and drop chunks, with copies taken along the way left as they were
+static void check_shared_sorted_list(mt19937_64& rng) {
+    auto less = [](uint32_t a, uint32_t b) { return a < b; };
+    SharedSortedList<uint32_t> list;
+    set<uint32_t> expected;
+    vector<pair<SharedSortedList<uint32_t>, vector<uint32_t>>> copies;
+    long bad = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint32_t value = rng() % 5000;
+        if (rng() % 3 && expected.insert(value).second) {
+            list.insert(value, less);
+        } else {
+            list.erase(value, less);
+            expected.erase(value);
+        }
+        if (i % 5000 == 0) {
+            copies.emplace_back(list, vector<uint32_t>(expected.begin(), expected.end()));
+        }
+        if (i % 1000 == 0) {
+            uint32_t bound = rng() % 5000;
+            auto it = list.partition_point([&](uint32_t other) { return other < bound; });
+            auto at = expected.lower_bound(bound);
+            bad += (it == list.end()) != (at == expected.end()) || (at != expected.end() && *it != *at);
+        }
+    }
+    bad += !equal(list.begin(), list.end(), expected.begin(), expected.end()) || list.size() != expected.size();
+    for (const auto& [copy, values] : copies) {
+        bad += !equal(copy.begin(), copy.end(), values.begin(), values.end());
+    }
+    report("SharedSortedList", bad);
+}
+
+// overlapping() and starting_between() against checking every live interval,
+// with erases in any order
+static void check_interval_index(mt19937_64& rng) {
+    IntervalIndex index;
+    map<uint32_t, pair<long long, long long>> live; // row id -> start, end
+    long bad = 0;
+    for (uint32_t row = 0; row < 30000; row++) {
+        if (live.empty() || rng() % 3) {
+            long long start = rng() % 100000;
+            long long end = start + 1 + rng() % (rng() % 20 ? 100 : 5000);
+            index.insert(start, end, row);
+            live[row] = {start, end};
+        } else {
+            auto it = live.begin();
+            advance(it, rng() % live.size());
+            index.erase(it->second.first, it->first);
+            live.erase(it);
+        }
+        if (row % 10 != 0) {
+            continue;
+        }
+        long long start = rng() % 100000, end = start + 1 + rng() % 300;
+        vector<pair<long long, uint32_t>> overlapping, starting;
+        for (const auto& [id, interval] : live) {
+            if ((start < interval.second && end > interval.first) || start == interval.first) {
+                overlapping.emplace_back(interval.first, id);
+            }
+            if (interval.first >= start && interval.first <= end) {
+                starting.emplace_back(interval.first, id);
+            }
+        }
+        sort(overlapping.begin(), overlapping.end());
+        sort(starting.begin(), starting.end());
+        auto ids = [](const vector<pair<long long, uint32_t>>& intervals) {
+            vector<uint32_t> result;
+            for (const auto& interval : intervals) {
+                result.push_back(interval.second);
+            }
+            return result;
+        };
+        bad += index.overlapping(start, end) != ids(overlapping) || index.starting_between(start, end) != ids(starting)
+            || index.count_starting_between(start, end) != starting.size();
+    }
+    report("IntervalIndex", bad);
+}
+
+// Facility::query() against filtering every event, whichever index the planner
+// starts from, as events are added, paid for, sold and cancelled in front of
+// and behind each other; find_event() along the way
+static void check_event_query(mt19937_64& rng) {
+    NullBuffer null;
+    streambuf* console = cout.rdbuf(&null); // the facility talks to the user
+    Facility facility;
+    User buyer("query buyer", 1e12, RESIDENT);
+    const int64_t first = 1900000000 / 3600 * 3600;
+    const vector<string> organizers = {"ada", "bo", "cy", "di", "ed"};
+    vector<string> live;
+    long bad = 0;
+    for (int i = 0; i < 20000; i++) {
+        int roll = rng() % 10;
+        if (live.empty() || roll < 4) {
+            int64_t start = first + (int64_t)(rng() % 2000) * 3600;
+            string name = "query " + to_string(i);
+            facility.add_event(Event(name, organizers[rng() % organizers.size()], system_clock::time_point(seconds(start)),
+                system_clock::time_point(seconds(start + 3600 * (1 + rng() % 3))), 20, rng() % 2, rng() % 2,
+                static_cast<MeetingStyle>(rng() % 4), 1));
+            live.push_back(name);
+        } else {
+            size_t pick = rng() % live.size();
+            const string& name = live[pick];
+            if (roll < 6) {
+                facility.remove_event(name);
+                live.erase(live.begin() + pick);
+            } else if (roll < 8) {
+                facility.process_payment(name, &buyer, facility.find_event(name)->amount_due());
+            } else {
+                facility.buy_ticket(name, &buyer, 1 + rng() % 30);
+            }
+        }
+        if (!live.empty()) {
+            const string& name = live[rng() % live.size()];
+            const Event* event = facility.find_event(name);
+            bad += !event || event->get_name() != name;
+        }
+        if (i % 20 != 0) {
+            continue;
+        }
+
+        EventQuery q;
+        if (rng() % 2) {
+            q.organized_by(rng() % 10 ? organizers[rng() % organizers.size()] : "nobody");
+        }
+        if (rng() % 2) {
+            int64_t from = first + (int64_t)(rng() % 2000) * 3600;
+            q.starting_between(system_clock::time_point(seconds(from)),
+                system_clock::time_point(seconds(from + (int64_t)(rng() % (rng() % 2 ? 24 : 2000)) * 3600)));
+        }
+        if (rng() % 2) {
+            q.confirmed(rng() % 2);
+        }
+        if (rng() % 3 == 0) {
+            q.public_events(rng() % 2);
+        }
+        if (rng() % 3 == 0) {
+            q.open_to_non(rng() % 2);
+        }
+        if (rng() % 3 == 0) {
+            q.with_tickets_left(1 + rng() % 100);
+        }
+        if (rng() % 2) {
+            q.ordered_by_start();
+        }
+
+        const vector<Event>& events = facility.get_events();
+        vector<size_t> expected;
+        for (size_t pos = 0; pos < events.size(); pos++) {
+            const Event& event = events[pos];
+            int64_t start = duration_cast<seconds>(event.get_start_time().time_since_epoch()).count();
+            bool flags[] = {event.is_confirmed(), event.is_public(), event.is_open_to_non()};
+            bool match = (!q.has_organizer || event.get_creator_username() == q.organizer)
+                && start >= q.start_from && start <= q.start_to && event.tickets_left() >= q.min_tickets_left;
+            for (int flag = 0; flag < EventQuery::FLAG_COUNT; flag++) {
+                if (q.flag_mask & (1 << flag)) {
+                    match &= flags[flag] == (bool)(q.flag_value & (1 << flag));
+                }
+            }
+            if (match) {
+                expected.push_back(pos);
+            }
+        }
+        if (q.by_start) {
+            stable_sort(expected.begin(), expected.end(), [&](size_t a, size_t b) {
+                return events[a].get_start_time() < events[b].get_start_time();
+            });
+        }
+        bad += facility.query(q) != expected;
+    }
+    cout.rdbuf(console);
+    report("Facility::query", bad);
+}
+
+// Two sessions load the same files, buy, cancel, reserve and pay in any
+// interleaving, and save in either order; a third then loads the result. What
+// each buyer paid must be what they still hold plus what they cancelled
+// (cancelling forfeits the ticket), what each organizer paid must be their
+// confirmed reservations plus their penalties, the budget must have grown by
+// what the organizers paid, and no event may be sold past its seats.
+static void check_merge(mt19937_64& rng) {
+    char dir[] = "/tmp/checksXXXXXX";
+    char* here = getcwd(nullptr, 0);
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        report("Merge on save", 1, "no temp dir");
+        free(here);
+        return;
+    }
+    NullBuffer null;
+    streambuf* console = cout.rdbuf(&null);
+    streambuf* errors = cerr.rdbuf(&null);
+    const double START = 100000, TICKET = 10;
+    const vector<string> buyers = {"b0", "b1", "b2", "b3", "b4", "b5"};
+    const vector<string> organizers = {"o0", "o1", "o2"};
+    const vector<string> public_events = {"meeting", "lecture"};
+    int year = Calendar::local(time(nullptr)).year + 1;
+    auto slot = [&](int month, int day, int hour) {
+        char date[16];
+        snprintf(date, sizeof(date), "%02d-%02d-%04d", month, day, year);
+        return System::reservation_start(date, hour);
+    };
+    double budget_before = 0;
+    {
+        System setup;
+        setup.create_user("host", START, RESIDENT);
+        for (const string& name : buyers) {
+            setup.create_user(name, START, RESIDENT);
+        }
+        for (const string& name : organizers) {
+            setup.create_user(name, START, RESIDENT);
+        }
+        User* host = setup.login_user("host");
+        setup.reserve_event(host, "meeting", slot(6, 1, 10), 2, true, true, Meeting, TICKET);
+        setup.reserve_event(host, "lecture", slot(6, 2, 10), 2, true, true, Lecture, TICKET);
+        setup.pay_for_event(host, "meeting");
+        setup.pay_for_event(host, "lecture");
+        budget_before = setup.get_facility().get_budget();
+    }
+
+    map<string, int> cancelled;
+    long bad = 0;
+    for (int round = 0; round < 30; round++) {
+        unique_ptr<System> sessions[2] = {make_unique<System>(), make_unique<System>()};
+        int canceller = rng() % 2; // two sessions cancelling one ticket lose it once, and the count would be off
+        for (int op = 0; op < 40; op++) {
+            int side = rng() % 2;
+            System& session = *sessions[side];
+            int roll = rng() % 10;
+            if (roll < 5 || (roll < 7 && side != canceller)) {
+                session.buy_ticket(session.login_user(buyers[rng() % buyers.size()]),
+                    public_events[rng() % public_events.size()], 1 + rng() % 4);
+            } else if (roll < 7) {
+                const string& name = buyers[rng() % buyers.size()];
+                cancelled[name] += session.cancel_ticket(session.login_user(name), public_events[rng() % public_events.size()]);
+            } else {
+                // private reservations in a few slots, so the sessions clash over names and times
+                User* organizer = session.login_user(organizers[rng() % organizers.size()]);
+                string name = rng() % 4 ? "r" + to_string(round) + "." + to_string(side) + "." + to_string(op) : "shared";
+                if (roll < 9) {
+                    // locals, so the draws do not depend on argument evaluation order
+                    int month = 1 + rng() % 2, day = 1 + rng() % 3, hour = 9 + rng() % 8, duration = 1 + rng() % 2;
+                    if (session.reserve_event(organizer, name, slot(month, day, hour), duration, false, false, Meeting, 0) && rng() % 3) {
+                        session.pay_for_event(organizer, name);
+                    }
+                } else if (roll == 9) {
+                    for (size_t pos : session.get_facility().query(EventQuery().organized_by(organizer->get_user_name()))) {
+                        session.cancel_event(organizer, session.get_facility().get_events()[pos].get_name());
+                        break;
+                    }
+                }
+            }
+        }
+        int first = rng() % 2;
+        sessions[first].reset();
+        sessions[1 - first].reset();
+
+        System result;
+        map<string, int> held;
+        map<string, double> reserved;
+        double confirmed_total = 0;
+        for (const Event& event : result.get_facility().get_events()) {
+            int sold = 0;
+            for (const Ticket& ticket : event.get_tickets()) {
+                if (ticket.is_purchased()) {
+                    held[ticket.get_owner()]++;
+                    sold++;
+                }
+            }
+            bad += sold > event.layout().get_capacity() || sold + event.tickets_left() != event.layout().get_capacity() * event.is_public();
+            if (event.is_confirmed() && event.get_creator_username() != "host") {
+                reserved[event.get_creator_username()] += event.amount_due();
+                confirmed_total += event.amount_due();
+            }
+        }
+        map<string, double> penalties;
+        for (const string& line : read_lines(PENALTY_LEDGER_FILE)) {
+            vector<string> fields;
+            stringstream ss(line);
+            for (string field; getline(ss, field, ',');) {
+                fields.push_back(field);
+            }
+            penalties[fields[1]] += stod(fields[3]);
+            confirmed_total += stod(fields[3]);
+        }
+        for (const string& name : buyers) {
+            double paid = START - result.login_user(name)->get_bank_balance();
+            bad += fabs(paid - TICKET * (held[name] + cancelled[name])) > 0.005;
+        }
+        for (const string& name : organizers) {
+            double paid = START - result.login_user(name)->get_bank_balance();
+            bad += fabs(paid - reserved[name] - penalties[name]) > 0.005;
+        }
+        bad += fabs(result.get_facility().get_budget() - budget_before - confirmed_total) > 0.005;
+    }
+
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    system((string("rm -rf ") + dir).c_str());
+    bad += chdir(here) != 0;
+    free(here);
+    report("Merge on save", bad);
+}
+
+// Threads take and give back tickets from a ShardedCounter at once, then
+// whatever is left is drained: nothing may be taken twice or lost. Then
+// threads send buyers at one event on sale, settling whenever they get the
+// lock. No seat may be sold past the capacity, buyers pay for exactly the
+// seats they got and the organizer for all of them, and the waitlisted are on
+// the waitlist in the order each thread sent them.
+static void check_on_sale(mt19937_64& rng) {
+    const int THREADS = 8, TOTAL = 1000;
+    long bad = 0;
+    ShardedCounter counter;
+    counter.reset(TOTAL);
+    vector<int> kept(THREADS);
+    vector<thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t, seed = rng()] {
+            mt19937_64 local(seed);
+            for (int misses = 0; misses < 20;) {
+                int n = 1 + local() % 5;
+                if (!counter.take(n, t)) {
+                    misses++;
+                    continue;
+                }
+                kept[t] += n;
+                if (local() % 4 == 0) {
+                    counter.give_back(n, local());
+                    kept[t] -= n;
+                }
+            }
+        });
+    }
+    for (thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    int taken = 0;
+    for (int t = 0; t < THREADS; t++) {
+        taken += kept[t];
+    }
+    while (counter.take(1, 0)) {
+        taken++;
+    }
+    bad += taken != TOTAL;
+
+    char dir[] = "/tmp/checksXXXXXX";
+    char* here = getcwd(nullptr, 0);
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        report("OnSale::submit/settle_sale", 1, "no temp dir");
+        free(here);
+        return;
+    }
+    mkdir("waitlist", 0755);
+    NullBuffer null;
+    streambuf* console = cout.rdbuf(&null);
+    const double START = 1000, TICKET = 10;
+    const int PER_THREAD = 12;
+    {
+        System system;
+        system.create_user("host", START, RESIDENT);
+        char date[16];
+        snprintf(date, sizeof(date), "06-01-%04d", Calendar::local(time(nullptr)).year + 1);
+        User* host = system.login_user("host");
+        system.reserve_event(host, "hot", System::reservation_start(date, 10), 2, true, true, Meeting, TICKET);
+        system.pay_for_event(host, "hot");
+        double host_before = host->get_bank_balance();
+
+        // a few cannot pay for what they ask
+        vector<vector<User*>> buyers(THREADS);
+        vector<vector<int>> counts(THREADS);
+        vector<vector<double>> balances(THREADS);
+        for (int t = 0; t < THREADS; t++) {
+            for (int i = 0; i < PER_THREAD; i++) {
+                string name = "b" + to_string(t) + "." + to_string(i);
+                balances[t].push_back(rng() % 5 ? START : TICKET);
+                system.create_user(name, balances[t].back(), NON_RESIDENT);
+                buyers[t].push_back(system.login_user(name));
+                counts[t].push_back(1 + rng() % 4);
+            }
+        }
+        system.open_sale("hot");
+        OnSale* sale = system.on_sale("hot");
+        vector<vector<SaleOutcome>> outcomes(THREADS);
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < PER_THREAD; i++) {
+                    future<SaleOutcome> outcome = sale->submit(buyers[t][i], counts[t][i]);
+                    while (outcome.wait_for(seconds(0)) != future_status::ready) {
+                        if (system_lock.try_lock()) {
+                            system.settle_sales();
+                            system_lock.unlock();
+                        } else {
+                            this_thread::yield();
+                        }
+                    }
+                    outcomes[t].push_back(outcome.get());
+                }
+            });
+        }
+        for (thread& thread : threads) {
+            thread.join();
+        }
+        system.close_sale("hot");
+
+        const Event& event = *system.get_facility().find_event("hot");
+        map<string, int> held;
+        int sold = 0;
+        for (const Ticket& ticket : event.get_tickets()) {
+            if (ticket.is_purchased()) {
+                held[ticket.get_owner()]++;
+                sold++;
+            }
+        }
+        bad += sold > event.layout().get_capacity() || sold + event.tickets_left() != event.layout().get_capacity();
+        bad += fabs(host->get_bank_balance() - host_before - TICKET * sold) > 0.005;
+        map<string, size_t> place;
+        for (UserHandle handle : event.get_waitlist()) {
+            place.emplace(system.get_users().get(handle)->get_user_name(), place.size());
+        }
+        size_t waitlisted = 0;
+        for (int t = 0; t < THREADS; t++) {
+            size_t last = 0;
+            bool first = true;
+            for (int i = 0; i < PER_THREAD; i++) {
+                const User* buyer = buyers[t][i];
+                const string& name = buyer->get_user_name();
+                int got = outcomes[t][i] == SALE_BOUGHT ? counts[t][i] : 0;
+                bad += held[name] != got;
+                bad += fabs(balances[t][i] - buyer->get_bank_balance() - TICKET * got) > 0.005;
+                auto on_waitlist = place.find(name);
+                bad += (outcomes[t][i] == SALE_WAITLISTED) != (on_waitlist != place.end());
+                if (on_waitlist != place.end()) {
+                    bad += !first && on_waitlist->second < last;
+                    last = on_waitlist->second;
+                    first = false;
+                    waitlisted++;
+                }
+            }
+        }
+        bad += waitlisted != place.size();
+    }
+    cout.rdbuf(console);
+    system((string("rm -rf ") + dir).c_str());
+    bad += chdir(here) != 0;
+    free(here);
+    report("OnSale::submit/settle_sale", bad);
+}
+
+// to_cents() rounds to the nearest cent and refuses what a Cents cannot hold
+static void check_money(mt19937_64& rng) {
+    long bad = 0;
+    for (int i = 0; i < 100000; i++) {
+        Cents cents = (Cents)(rng() % ((uint64_t)INT32_MAX * 2 + 1) - INT32_MAX);
+        bad += to_cents(to_dollars(cents)) != cents;
+    }
+    for (double dollars : {MAX_PRICE + 0.01, -MAX_PRICE - 0.02, 1e12, nan("")}) {
+        try {
+            to_cents(dollars);
+            bad++;
+        } catch (const out_of_range&) {
+        }
+    }
+    report("to_cents", bad);
+}
+
+int main(int argc, char* argv[]) {
+    mt19937_64 rng(argc > 1 ? stoull(argv[1]) : 1);
+    check_calendar(rng);
+    check_seat_map(rng);
+    check_timing_wheel(rng);
+    check_checkpoint(); // forks, so before any threads
+    check_rcu();
+    check_name_index(rng);
+    check_shared_sorted_list(rng);
+    check_interval_index(rng);
+    check_event_query(rng);
+    check_merge(rng);
+    check_on_sale(rng);
+    check_money(rng);
+    return failures;
+}
@@ -0,0 +1,256 @@
+#ifndef CLIENT_HPP
+#define CLIENT_HPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.hpp"
+
+using namespace std;
+
+// Thin client for the server mode: asks the same questions as the standalone
+// menu, sends one request per action and prints whatever the server answers.
+class Client {
+    int fd = -1;
+    string inbuf;
+
+public:
+    ~Client() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool connect_to(const string& socket_path) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        strcpy(addr.sun_path, socket_path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        return fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    // sends a request and waits for its response; false on ERR or a lost connection
+    bool request(const vector<string>& fields, string& body) {
+        body.clear();
+        string line = encode_request(fields);
+        size_t sent = 0;
+        while (sent < line.size()) {
+            ssize_t n = write(fd, line.data() + sent, line.size() - sent);
+            if (n <= 0) {
+                body = "Lost connection to the server.\n";
+                return false;
+            }
+            sent += n;
+        }
+
+        size_t newline;
+        while ((newline = inbuf.find('\n')) == string::npos) {
+            if (!receive()) {
+                body = "Lost connection to the server.\n";
+                return false;
+            }
+        }
+        bool ok;
+        size_t length;
+        if (!decode_response_header(inbuf.substr(0, newline), ok, length)) {
+            body = "Malformed response from the server.\n";
+            return false;
+        }
+        inbuf.erase(0, newline + 1);
+        while (inbuf.size() < length) {
+            if (!receive()) {
+                body = "Lost connection to the server.\n";
+                return false;
+            }
+        }
+        body = inbuf.substr(0, length);
+        inbuf.erase(0, length);
+        return ok;
+    }
+
+    // same as request, printing the response body
+    bool send(const vector<string>& fields) {
+        string body;
+        bool ok = request(fields, body);
+        cout << body;
+        return ok;
+    }
+
+private:
+    bool receive() {
+        char buf[4096];
+        ssize_t got = read(fd, buf, sizeof(buf));
+        if (got <= 0) {
+            return false;
+        }
+        inbuf.append(buf, got);
+        return true;
+    }
+};
+
+// reads a full line after a number was read with >>
+static string read_line() {
+    string line;
+    getline(cin, line);
+    return line;
+}
+
+// the interactive menu from program.cpp, backed by a server
+inline int run_thin_client(const string& socket_path) {
+    Client client;
+    if (!client.connect_to(socket_path)) {
+        cerr << "Could not connect to the server at " << socket_path << "\n";
+        return 1;
+    }
+
+    string username;
+    cout << "Welcome to our facility ticketing system!\n";
+    cout << "\nLogin\nUsername: ";
+    cin >> username;
+    string body;
+    if (!client.request({"LOGIN", username}, body)) {
+        double balance;
+        int type;
+        cout << "No existing user found, creating new user...\n";
+        cout << "Please tell me, how much money do you have in your budget?\n";
+        cin >> balance;
+        cout << "Please enter whatever best describes you: 1, 2, or 3\n1) Worker for the city\n2) Resident of Newton\n3) Non-Resident of Newton\n(Default: non-resident)\n";
+        if (!(cin >> type)) {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            type = NON_RESIDENT + 1;
+        }
+        if (!client.send({"CREATE", username, to_string(balance), to_string(type - 1)})) {
+            return 1;
+        }
+    }
+    cout << "Thanks for using our system, " << username << "!\n";
+
+    while (true) {
+        cout << "\nOptions:\n1. View Schedule\n2. Make reservation\n3. View and confirm your events/Make a payment\n4. Buy a ticket\n5. Cancel a ticket\n6. Cancel event\n7. View my tickets\n8. Quit\n";
+        int operation;
+        cin >> operation;
+        if (!cin) {
+            break;
+        }
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+        string event_name;
+        switch (operation) {
+            case 1: {
+                int days;
+                cout << "How many days of the schedule would you like to see (up to 14 days)? ";
+                cin >> days;
+                if (cin.fail()) {
+                    cin.clear();
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                    cout << "Invalid input. Please enter a number.\n";
+                    break;
+                }
+                client.send({"SCHEDULE", to_string(days)});
+                break;
+            }
+            case 2: {
+                string date_str, start_hour, duration, pubpriv, open_to_non, style_choice, cost_to_attend;
+                cout << "Enter event name: ";
+                getline(cin, event_name);
+                cout << "What date do you want the event (MM-DD-YYYY)? ";
+                getline(cin, date_str);
+                cout << "Starting time, hour in military time (e.g., 20 for 8 PM): ";
+                start_hour = read_line();
+                cout << "Length in hours (integer only): ";
+                duration = read_line();
+                cout << "Is the event public or private (1 for public, 0 for private): ";
+                pubpriv = read_line();
+                cout << "Is the event open to non-residents (1 for open, 0 for closed): ";
+                open_to_non = read_line();
+                cout << "Choose meeting style (1 for Meeting, 2 for Lecture, 3 for Wedding, 4 for Dance Room): ";
+                style_choice = read_line();
+                cout << "If this event is public how much would you like to charge for a ticket? If private, enter 0.\n";
+                cost_to_attend = read_line();
+                client.send({"RESERVE", event_name, date_str, start_hour, duration, pubpriv, open_to_non, style_choice, cost_to_attend});
+                break;
+            }
+            case 3: {
+                client.send({"MYEVENTS"});
+                cout << "Enter the name of the event you wish to pay for: ";
+                getline(cin, event_name);
+                if (!client.request({"COST", event_name}, body)) {
+                    cout << body;
+                    break;
+                }
+                istringstream costs(body);
+                double total_cost, balance;
+                costs >> total_cost >> balance;
+                cout << "Your current budget is: $" << balance << endl;
+                cout << "Total cost of the event: $" << total_cost << endl;
+                if (balance < total_cost) {
+                    cout << "Insufficient funds to cover the cost of the event.\n";
+                    break;
+                }
+                char userConfirmation;
+                cout << "Do you wish to proceed with the payment? (Y/N): ";
+                cin >> userConfirmation;
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                if (toupper(userConfirmation) == 'Y') {
+                    client.send({"PAY", event_name});
+                } else {
+                    cout << "Payment cancelled." << endl;
+                }
+                break;
+            }
+            case 4: {
+                cout << "Buying a ticket! These are all of the available events:" << endl;
+                client.send({"AVAILABLE"});
+                cout << "Enter the event name in which you want to attend: \n";
+                cout << "If the event is sold out you will automatically be added to the waitlist.\n";
+                getline(cin, event_name);
+                int count;
+                cout << "How many tickets? Group bookings get seats next to each other: ";
+                cin >> count;
+                if (cin.fail()) {
+                    cin.clear(); // Clear error state
+                    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Ignore wrong input
+                    cout << "Invalid input. Please enter a number.\n";
+                    break;
+                }
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                client.send({"BUY", event_name, to_string(count)});
+                break;
+            }
+            case 5:
+                cout << "Cancelling a ticket.\n";
+                cout << "Enter the name of the event you want to cancel your ticket for.\n";
+                getline(cin, event_name);
+                client.send({"CANCELTICKET", event_name});
+                break;
+            case 6:
+                cout << "Cancelling a hosting event!" << endl;
+                cout << "Enter the event name in which you host and want to cancel: " << endl;
+                getline(cin, event_name);
+                client.send({"CANCELEVENT", event_name});
+                break;
+            case 7:
+                client.send({"TICKETS"});
+                break;
+            case 8:
+                cout << "Logging out, see you next time!\n";
+                return 0;
+            default:
+                cout << "Invalid option. Please try again.\n";
+                break;
+        }
+    }
+    return 0;
+}
+
+#endif // CLIENT_HPP
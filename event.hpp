@@ -4,10 +4,18 @@
 #include <iostream>
 #include <string>
 #include <chrono>
-#include <deque>
+#include <vector>
 #include <map>
+#include <memory>
 #include <algorithm>
+#include <string_view>
+#include <charconv>
 #include "ticket.hpp"
+#include "pricing.hpp"
+#include "seat_map.hpp"
+#include "name_table.hpp"
+#include "money.hpp"
+#include "user_registry.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -20,148 +28,380 @@ enum MeetingStyle {
 };
 
 class Event {
-    string event_name;
-    string creator_username; // Username of the event creator
-    time_point<system_clock> start_time;
-    time_point<system_clock> end_time;
-    double price_per_hour;
-    bool confirmed;
-    bool pubpriv;          // true for public, false for private
-    bool open_to_non;      // true for open, false for closed to non-residents
-    MeetingStyle meeting_style;
-    deque<Ticket> tickets;
-    deque<User*> waitlist;
-    double cost_to_attend;
+    // The record proper: names as NameTable ids, times in whole minutes since the
+    // epoch (signed, an unreadable date loads as 1900), money in cents and the
+    // yes/no fields as bits; 40 bytes with the pointer to the BoxOffice. Ticket
+    // sales and the waitlist live there, and only events selling tickets or
+    // keeping a waitlist get one.
+    uint32_t name_id;
+    uint32_t creator_id;
+    int32_t start_minute;
+    int32_t end_minute;
+    Cents price_per_hour;
+    Cents cost_to_attend;
+    uint8_t meeting_style;
+    mutable uint8_t flags = 0;
+
+    enum Flag : uint8_t {
+        CONFIRMED = 1 << 0,
+        PUBLIC = 1 << 1,           // set for public, clear for private
+        OPEN_TO_NON = 1 << 2,      // open to non-residents
+        WAITLIST_PENDING = 1 << 3, // still in its file, see defer_waitlist
+        TICKETS_PENDING = 1 << 4,  // still in ticket_section, see hydrate_tickets
+        // set as the event's deadlines pass, see System::tick
+        OVERRIDE_LOCKED = 1 << 5,   // too close to the start to be displaced by another booking
+        LATE_CANCELLATION = 1 << 6, // cancelling now costs the late fee
+        WAITLIST_CLOSED = 1 << 7,   // the event has started
+    };
+
+    // One ticket per seat of the style's layout, indexed by seat number, and the free
+    // seats as a bitmap. Tickets of a loaded event stay in their events_data.csv text
+    // until first used; the const accessors parse them on demand, hence mutable.
+    struct BoxOffice {
+        vector<Ticket> tickets;
+        SeatMap seats;
+        map<string, int> holders; // reverse index: who holds how many of the sold tickets
+        string ticket_section;    // ",price,holder,purchased" per ticket, while unparsed
+        vector<UserHandle> waitlist;
+    };
+    mutable unique_ptr<BoxOffice> box_office;
+
+    bool has_flag(Flag flag) const {
+        return flags & flag;
+    }
 
-public:
-    Event(const string& name, const string& creator, const time_point<system_clock>& start, const time_point<system_clock>& end, double price, bool public_private, bool open_non_residents, MeetingStyle style, double cost_to_attend)
-        : event_name(name), creator_username(creator), start_time(start), end_time(end), price_per_hour(price), confirmed(false), pubpriv(public_private), open_to_non(open_non_residents), meeting_style(style), cost_to_attend(cost_to_attend) {
-            deque<Ticket> new_tickets;
-            if(pubpriv) { // initializing 25 5ickets
-                for (int i = 0; i < 25; i++) {
-                    Ticket t(name, cost_to_attend);
-                    new_tickets.push_back(t);
+    void set_flag(Flag flag, bool on) const {
+        flags = on ? (flags | flag) : (flags & ~flag);
+    }
+
+    BoxOffice& office() const {
+        if (!box_office) {
+            box_office = make_unique<BoxOffice>();
+        }
+        return *box_office;
+    }
+
+    static int32_t to_minutes(const time_point<system_clock>& t) {
+        return floor<minutes>(t).time_since_epoch().count();
+    }
+
+    static time_point<system_clock> from_minutes(int32_t m) {
+        return time_point<system_clock>(minutes(m));
+    }
+
+    void hydrate_tickets() const {
+        if (!has_flag(TICKETS_PENDING)) {
+            return;
+        }
+        set_flag(TICKETS_PENDING, false);
+        assign_seats();
+        if (!box_office) {
+            return;
+        }
+        BoxOffice& office = *box_office;
+        size_t seat = 0;
+        for_each_ticket_field(office.ticket_section, [this, &office, &seat](string_view price, string_view owner, string_view purchased) {
+            size_t at = seat++;
+            if (price.empty() || owner.empty() || purchased.empty() || office.tickets.empty()) {
+                return; // blank tickets are already there
+            }
+            double cost = 0;
+            from_chars(price.data(), price.data() + price.size(), cost);
+            Ticket ticket(get_name(), cost, string(owner));
+            ticket.set_purchased(purchased == "1");
+            if (at >= office.tickets.size()) {
+                office.tickets.resize(at + 1, Ticket(get_name(), get_cost_to_attend())); // sold past the layout's seats, kept as they are
+            }
+            office.tickets[at] = move(ticket);
+            if (purchased == "1") {
+                if (at < (size_t)layout().get_capacity()) {
+                    office.seats.take(at);
                 }
+                office.holders[string(owner)]++;
+            }
+        });
+        // Saved before the style had its own layout, when every event had 25 seats. It keeps
+        // the seats it was sold with, so a sold-out event stays sold out for its waitlist.
+        int capacity = layout().get_capacity();
+        if (seat > 0 && seat < (size_t)capacity && !office.tickets.empty()) {
+            office.tickets.erase(office.tickets.begin() + seat, office.tickets.end());
+            for (int extra = seat; extra < capacity; extra++) {
+                office.seats.take(extra);
+            }
+        }
+        string().swap(office.ticket_section);
+    }
+
+    // blank tickets for every seat; private events sell none
+    void assign_seats() const {
+        if (is_public()) {
+            office().tickets.assign(layout().get_capacity(), Ticket(get_name(), get_cost_to_attend()));
+            office().seats = SeatMap(layout());
+        }
+    }
+
+    void add_holder(const string& user_name) {
+        office().holders[user_name]++;
+    }
+
+    void remove_holder(const string& user_name) {
+        auto it = office().holders.find(user_name);
+        if (it != office().holders.end() && --it->second == 0) {
+            office().holders.erase(it);
+        }
+    }
+
+public:
+    Event(string name, string creator, const time_point<system_clock>& start, const time_point<system_clock>& end, double price, bool public_private, bool open_non_residents, MeetingStyle style, double cost_to_attend)
+        : name_id(NameTable::intern(name)), creator_id(NameTable::intern(creator)), start_minute(to_minutes(start)), end_minute(to_minutes(end)),
+          price_per_hour(to_cents(price)), cost_to_attend(to_cents(cost_to_attend)), meeting_style(style) {
+            set_flag(PUBLIC, public_private);
+            set_flag(OPEN_TO_NON, open_non_residents);
+            assign_seats();
+        }
+
+    // an event loaded from events_data.csv; its tickets are parsed from ticket_section when first used
+    Event(string name, string creator, const time_point<system_clock>& start, const time_point<system_clock>& end, double price, bool public_private, bool open_non_residents, MeetingStyle style, double cost_to_attend, string ticket_section)
+        : name_id(NameTable::intern(name)), creator_id(NameTable::intern(creator)), start_minute(to_minutes(start)), end_minute(to_minutes(end)),
+          price_per_hour(to_cents(price)), cost_to_attend(to_cents(cost_to_attend)), meeting_style(style) {
+            set_flag(PUBLIC, public_private);
+            set_flag(OPEN_TO_NON, open_non_residents);
+            set_flag(TICKETS_PENDING, true);
+            if (!ticket_section.empty()) {
+                office().ticket_section = move(ticket_section);
             }
-            tickets = new_tickets;
-            deque<User*> new_waitlist;
-            waitlist = new_waitlist;
         }
 
+    Event(const Event& other)
+        : name_id(other.name_id), creator_id(other.creator_id), start_minute(other.start_minute), end_minute(other.end_minute),
+          price_per_hour(other.price_per_hour), cost_to_attend(other.cost_to_attend), meeting_style(other.meeting_style), flags(other.flags),
+          box_office(other.box_office ? make_unique<BoxOffice>(*other.box_office) : nullptr) {}
+
+    Event(Event&&) noexcept = default;
+
+    Event& operator=(const Event& other) {
+        if (this != &other) {
+            Event copy(other);
+            *this = move(copy);
+        }
+        return *this;
+    }
+
+    Event& operator=(Event&&) noexcept = default;
+
     //calculates price for event
     double calculate_total_cost() const {
         // Calculate the duration in hours
-        auto duration = duration_cast<hours>(end_time - start_time).count();
-        
+        auto duration = duration_cast<hours>(get_end_time() - get_start_time()).count();
+
         // Calculate the total cost
-        return price_per_hour * duration;
+        return Pricing::reservation_cost(get_price_per_hour(), duration);
+    }
+
+    // what the organizer pays to confirm the reservation
+    double amount_due() const {
+        return Pricing::amount_due(calculate_total_cost());
     }
 
     // gets waitlist
-    deque<User*> get_waitlist() const{
-        return waitlist;
+    const vector<UserHandle>& get_waitlist() const{
+        static const vector<UserHandle> none;
+        return box_office ? box_office->waitlist : none;
     }
 
     // Accessor methods for all fields
-    string get_name() const {
-        return event_name;
+    const string& get_name() const {
+        return NameTable::name(name_id);
     }
 
-    string get_creator_username() const {
-        return creator_username;
+    const string& get_creator_username() const {
+        return NameTable::name(creator_id);
     }
 
     time_point<system_clock> get_start_time() const {
-        return start_time;
+        return from_minutes(start_minute);
     }
 
     time_point<system_clock> get_end_time() const {
-        return end_time;
+        return from_minutes(end_minute);
     }
 
     double get_price_per_hour() const {
-        return price_per_hour;
+        return to_dollars(price_per_hour);
     }
 
     bool is_confirmed() const {
-        return confirmed;
+        return has_flag(CONFIRMED);
     }
 
     bool is_public() const {
-        return pubpriv;
+        return has_flag(PUBLIC);
     }
 
     bool is_open_to_non() const {
-        return open_to_non;
+        return has_flag(OPEN_TO_NON);
     }
 
     MeetingStyle get_meeting_style() const {
-        return meeting_style;
+        return static_cast<MeetingStyle>(meeting_style);
     }
 
     void confirm() {
-        confirmed = true;
+        set_flag(CONFIRMED, true);
     }
 
     void cancel() {
-        confirmed = false;
+        set_flag(CONFIRMED, false);
+    }
+
+    void lock_override() {
+        set_flag(OVERRIDE_LOCKED, true);
+    }
+
+    bool is_override_locked() const {
+        return has_flag(OVERRIDE_LOCKED);
+    }
+
+    void start_late_cancellation() {
+        set_flag(LATE_CANCELLATION, true);
+    }
+
+    bool is_late_cancellation() const {
+        return has_flag(LATE_CANCELLATION);
+    }
+
+    // nobody joins the waitlist any more and whoever was on it is let go
+    void close_waitlist() {
+        set_waitlist({});
+        set_flag(WAITLIST_CLOSED, true);
+    }
+
+    bool is_waitlist_closed() const {
+        return has_flag(WAITLIST_CLOSED);
     }
 
     double get_cost_to_attend() const {
-        return cost_to_attend;
+        return to_dollars(cost_to_attend);
+    }
+
+    const SeatLayout& layout() const {
+        return SeatLayout::of(get_meeting_style());
+    }
+
+    // by seat number
+    const vector<Ticket>& get_tickets() const {
+        static const vector<Ticket> none;
+        hydrate_tickets();
+        return box_office ? box_office->tickets : none;
+    }
+
+    bool tickets_loaded() const {
+        return !has_flag(TICKETS_PENDING);
+    }
+
+    // the unparsed tickets, as they appear after the header in events_data.csv
+    const string& get_ticket_section() const {
+        static const string none;
+        return box_office ? box_office->ticket_section : none;
+    }
+
+    int tickets_left() const {
+        hydrate_tickets();
+        return box_office ? box_office->seats.free_count() : 0;
+    }
+
+    // the waitlist stays in its file until the caller needs it and hands it over with set_waitlist
+    void defer_waitlist() {
+        set_flag(WAITLIST_PENDING, true);
+    }
+
+    bool waitlist_loaded() const {
+        return !has_flag(WAITLIST_PENDING);
     }
 
-    deque<Ticket> get_tickets() const {
-        return tickets;
+    void set_waitlist(vector<UserHandle> users) {
+        if (box_office || !users.empty()) {
+            office().waitlist = move(users);
+        }
+        set_flag(WAITLIST_PENDING, false);
     }
 
     // checks if there are tickets still available
     bool has_tickets() {
-        for (auto& ticket : tickets) {
-            if (!ticket.is_purchased()) {
-                cout << "There are tickets still available.\n";
-                return true;
-            }
+        if (tickets_left() > 0) {
+            cout << "There are tickets still available.\n";
+            return true;
         }
         cout << "No more tickets.\n";
         return false;
     }
 
-    // adds user to the waitlist
-    void join_waitlist(User* user) {
+    // adds user to the waitlist, unless the event has started
+    bool join_waitlist(User* user) {
+        if (is_waitlist_closed()) {
+            cout << "The event has started, its waitlist is closed.\n";
+            return false;
+        }
         cout << "User added to the waitlist.\n";
-        waitlist.push_back(user);
+        office().waitlist.push_back(user->get_handle());
+        return true;
     }
 
     //purchase ticket logic
     bool purchase_ticket(User* user) {
-        if (user->get_bank_balance() < cost_to_attend) {
+        return purchase_tickets(user, 1);
+    }
+
+    // buys count adjacent seats in the best row that still has them
+    bool purchase_tickets(User* user, int count) {
+        hydrate_tickets();
+        if (user->get_bank_balance() < get_cost_to_attend() * count) {
             cout << "User does not have enough money in bank account.\n";
             return false;
         }
-        user->set_bank_balance(user->get_bank_balance() - cost_to_attend);
-        Ticket t = tickets.front();
-        tickets.pop_front();
-        Ticket new_ticket(t.get_event_name(), t.get_cost(), user->get_user_name());
-        user->add_ticket(new_ticket);
-        tickets.push_back(new_ticket);
+        int first = assign_block(user, count);
+        if (first < 0) {
+            cout << "There are no " << count << " seats left together.\n";
+            return false;
+        }
+        user->set_bank_balance(user->get_bank_balance() - get_cost_to_attend() * count);
+        for (int seat = first; seat < first + count; seat++) {
+            cout << "Seat: " << layout().label(seat) << "\n";
+        }
         return true;
     }
 
-    // seraches through tickets for a users 
+    // Gives user the best count adjacent seats, without charging for them; the
+    // first seat, or -1 if there are none. See Facility::settle_sale.
+    int assign_block(User* user, int count) {
+        hydrate_tickets();
+        BoxOffice& office = this->office();
+        int first = office.seats.best_block(count);
+        for (int seat = first; first >= 0 && seat < first + count; seat++) {
+            office.seats.take(seat);
+            office.tickets[seat] = Ticket(get_name(), office.tickets[seat].get_cost(), user->get_user_name());
+            user->add_ticket(office.tickets[seat]);
+            add_holder(user->get_user_name());
+        }
+        return first;
+    }
+
+    // seraches through tickets for a users
     bool find_users_ticket(string user_name) {
-        for (auto& ticket : tickets) {
-            if (ticket.get_owner() == user_name) {
-                cout << "found the ticket\n"; 
-                return true;
-            }
+        hydrate_tickets();
+        if (box_office && box_office->holders.count(user_name)) {
+            cout << "found the ticket\n";
+            return true;
         }
         return false;
     }
 
   // cancells a users ticket and checks waitlist
-  void cancel_users_ticket(const string& user_name) {
+  void cancel_users_ticket(const string& user_name, UserRegistry& users) {
+    hydrate_tickets();
     bool ticketFound = false;
+    vector<Ticket>& tickets = office().tickets;
+    vector<UserHandle>& waitlist = office().waitlist;
 
     // Iterate to find the user's ticket
     for (auto it = tickets.begin(); it != tickets.end(); ) {
@@ -169,19 +409,21 @@ public:
             cout << "Found the ticket. Cancelling and checking waitlist.\n";
             it->set_purchased(false); // Mark the ticket as not purchased
             it->set_owner("");       // Clear the holder name
+            remove_holder(user_name);
 
             ticketFound = true;
 
             // Continue to check the waitlist
             while (!waitlist.empty()) {
-                User* nextUser = waitlist.front();
-                waitlist.pop_front(); // Remove the user from the waitlist
+                User* nextUser = users.get(waitlist.front());
+                waitlist.erase(waitlist.begin()); // Remove the user from the waitlist
 
-                if (nextUser->get_bank_balance() >= cost_to_attend) {
+                if (nextUser->get_bank_balance() >= get_cost_to_attend()) {
                     // If the waitlisted user can afford the ticket, process the purchase
-                    nextUser->set_bank_balance(nextUser->get_bank_balance() - cost_to_attend);
+                    nextUser->set_bank_balance(nextUser->get_bank_balance() - get_cost_to_attend());
                     it->set_owner(nextUser->get_user_name());
                     it->set_purchased(true);
+                    add_holder(nextUser->get_user_name());
 
                     nextUser->add_ticket(*it);  // Add the ticket to the next user's list of tickets
                     cout << "Ticket transferred to waitlisted user: " << nextUser->get_user_name() << endl;
@@ -191,11 +433,13 @@ public:
                 }
             }
 
-            // If no suitable user is found in the waitlist, add the ticket back as available
+            // If no suitable user is found in the waitlist, the seat is free again
             cout << "No suitable user found in waitlist. Ticket remains available.\n";
-            tickets.erase(it);
-            Ticket t(event_name, cost_to_attend);
-            tickets.push_front(t); // pushes to front since that's where blank tickets belong.
+            int seat = it - tickets.begin();
+            *it = Ticket(get_name(), get_cost_to_attend());
+            if (seat < layout().get_capacity()) {
+                office().seats.release(seat);
+            }
             break;  // Exit the loop after handling the ticket
         } else {
             ++it;  // Only increment if no ticket was found, to avoid skipping elements
@@ -206,23 +450,46 @@ public:
         cout << "No ticket to cancel found for user: " << user_name << endl;
     }
 }
- 
- //loads tickets form save
-    void load_ticket(const Ticket& new_ticket) {
-        tickets.pop_front();
-        tickets.push_back(new_ticket);
+
+    // the names of everyone holding a sold ticket
+    vector<string> holder_names() {
+        hydrate_tickets();
+        vector<string> names;
+        if (box_office) {
+            for (const auto& holder : box_office->holders) {
+                names.push_back(holder.first);
+            }
+        }
+        return names;
     }
 
-    //cancels all tickets and refunds everyone
-    void cancel_all_tickets(map<string, User> users) {
+    // Cancels every sold ticket, refunding holders from the organizer. Refunds are grouped
+    // per holder off the reverse index, so each affected user is written once and blank
+    // tickets cost nothing. Clears the waitlist; the caller erases the event afterwards.
+    void cancel_all_tickets(UserRegistry& users) {
         cout << "cancelling all tickets\n";
-        for (auto& ticket : tickets) {
-            User temp = users[ticket.get_owner()];
-            temp.cancel_ticket(event_name);
+        hydrate_tickets();
+        User* organizer = users.find(get_creator_username());
+        double refunded = 0;
+        if (box_office) {
+            for (const auto& holder : box_office->holders) {
+                User* user = users.find(holder.first);
+                if (!user) {
+                    continue; // holder no longer exists, nobody to refund
+                }
+                double amount = holder.second * get_cost_to_attend();
+                user->get_payment(amount);
+                user->remove_tickets_for(get_name());
+                refunded += amount;
+            }
+            box_office->holders.clear();
         }
+        if (organizer) {
+            organizer->get_payment(-refunded);
+        }
+        set_waitlist({});
     }
 
 };
 
 #endif // EVENT_HPP
-
@@ -0,0 +1,282 @@
+#ifndef EVENT_COLUMNS_HPP
+#define EVENT_COLUMNS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include "event.hpp"
+#include "event_query.hpp"
+#include "row_order.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// one bit per event position
+class PositionBits {
+    vector<uint64_t> words;
+    size_t n = 0;
+
+public:
+    size_t size() const {
+        return n;
+    }
+
+    size_t word_count() const {
+        return words.size();
+    }
+
+    uint64_t word(size_t w) const {
+        return words[w];
+    }
+
+    bool test(size_t pos) const {
+        return (words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    void set(size_t pos, bool value) {
+        uint64_t bit = uint64_t(1) << (pos % 64);
+        words[pos / 64] = value ? (words[pos / 64] | bit) : (words[pos / 64] & ~bit);
+    }
+
+    // bits from pos on move up by one, a word at a time with the top bit carried over
+    void insert(size_t pos, bool value) {
+        if (n % 64 == 0) {
+            words.push_back(0);
+        }
+        n++;
+        size_t w = pos / 64;
+        uint64_t below = (uint64_t(1) << (pos % 64)) - 1;
+        uint64_t carry = words[w] >> 63;
+        words[w] = (words[w] & below) | ((words[w] & ~below) << 1) | (uint64_t(value) << (pos % 64));
+        for (size_t i = w + 1; i < words.size(); i++) {
+            uint64_t next = words[i] >> 63;
+            words[i] = (words[i] << 1) | carry;
+            carry = next;
+        }
+    }
+
+    // bits after pos move down by one, a word at a time with the low bit carried over
+    void erase(size_t pos) {
+        size_t w = pos / 64;
+        uint64_t below = (uint64_t(1) << (pos % 64)) - 1;
+        words[w] = (words[w] & below) | ((words[w] >> 1) & ~below);
+        for (size_t i = w; i + 1 < words.size(); i++) {
+            words[i] |= (words[i + 1] & 1) << 63;
+            words[i + 1] >>= 1;
+        }
+        n--;
+        if (n % 64 == 0) {
+            words.pop_back();
+        }
+    }
+
+    void clear() {
+        words.clear();
+        n = 0;
+    }
+};
+
+// Structure-of-arrays copy of the Event fields that queries filter on, plus
+// the secondary indexes Facility::query() plans with: a bitset per event state
+// and each organizer's events. Scanning these small arrays beats walking
+// vector<Event>, whose elements carry strings and ticket vectors; only the
+// events that pass are looked at afterwards. Row i mirrors Facility::events[i],
+// so Facility reports every append, erase and change. Organizers' lists hold
+// row ids rather than positions, so an erase only touches its own organizer.
+class EventColumns {
+public:
+    static const uint32_t ANY_CREATOR = UINT32_MAX;
+    static const uint32_t NO_CREATOR = UINT32_MAX - 1; // matches no event
+    static const int32_t TICKETS_UNKNOWN = -1;          // tickets not parsed yet, see Event
+
+private:
+    vector<int64_t> start;
+    vector<int64_t> end;
+    vector<uint32_t> creator;
+    vector<int32_t> tickets_left;
+    vector<uint32_t> row_id;                        // see RowOrder
+    RowOrder order;
+    PositionBits flag_bits[EventQuery::FLAG_COUNT]; // bit f is EventQuery::Flag 1 << f
+    map<string, uint32_t, less<>> creator_ids;      // interned usernames, ids are never reused
+    map<uint32_t, vector<uint32_t>> by_creator;     // organizer -> row ids, ascending
+
+    static int64_t to_seconds(const time_point<system_clock>& t) {
+        return duration_cast<seconds>(t.time_since_epoch()).count();
+    }
+
+    // does not parse an event's tickets just to count them
+    static int32_t tickets_left_of(const Event& event) {
+        return event.tickets_loaded() ? event.tickets_left() : TICKETS_UNKNOWN;
+    }
+
+    static uint8_t flags_of(const Event& event) {
+        return (event.is_confirmed() ? EventQuery::CONFIRMED : 0) | (event.is_public() ? EventQuery::PUBLIC : 0)
+            | (event.is_open_to_non() ? EventQuery::OPEN_TO_NON : 0);
+    }
+
+    uint32_t intern(const string& username) {
+        auto it = creator_ids.find(username);
+        if (it == creator_ids.end()) {
+            it = creator_ids.emplace(username, (uint32_t)creator_ids.size()).first;
+        }
+        return it->second;
+    }
+
+    void set_flags(size_t pos, uint8_t flags) {
+        for (int f = 0; f < EventQuery::FLAG_COUNT; f++) {
+            flag_bits[f].set(pos, (flags >> f) & 1);
+        }
+    }
+
+    // the events matching the query's flags, 64 positions at a time
+    uint64_t flag_word(size_t w, const EventQuery& query) const {
+        uint64_t bits = ~uint64_t(0);
+        for (int f = 0; f < EventQuery::FLAG_COUNT; f++) {
+            if ((query.flag_mask >> f) & 1) {
+                bits &= ((query.flag_value >> f) & 1) ? flag_bits[f].word(w) : ~flag_bits[f].word(w);
+            }
+        }
+        size_t n = start.size();
+        if (w == n / 64 && n % 64 != 0) {
+            bits &= (uint64_t(1) << (n % 64)) - 1;
+        }
+        return bits;
+    }
+
+public:
+    // a row for the event added at the back
+    void append(const Event& event) {
+        start.push_back(to_seconds(event.get_start_time()));
+        end.push_back(to_seconds(event.get_end_time()));
+        uint32_t id = intern(event.get_creator_username());
+        creator.push_back(id);
+        tickets_left.push_back(tickets_left_of(event));
+        uint8_t flags = flags_of(event);
+        for (int f = 0; f < EventQuery::FLAG_COUNT; f++) {
+            flag_bits[f].insert(start.size() - 1, (flags >> f) & 1);
+        }
+        row_id.push_back(order.append());
+        by_creator[id].push_back(row_id.back()); // ids only grow, so this stays sorted
+    }
+
+    void erase(size_t pos) {
+        vector<uint32_t>& own = by_creator[creator[pos]];
+        own.erase(lower_bound(own.begin(), own.end(), row_id[pos]));
+        order.erase(row_id[pos]);
+        start.erase(start.begin() + pos);
+        end.erase(end.begin() + pos);
+        creator.erase(creator.begin() + pos);
+        tickets_left.erase(tickets_left.begin() + pos);
+        row_id.erase(row_id.begin() + pos);
+        for (auto& bits : flag_bits) {
+            bits.erase(pos);
+        }
+    }
+
+    // the event at pos changed, e.g. it was paid for or sold a ticket
+    void update(size_t pos, const Event& event) {
+        set_flags(pos, flags_of(event));
+        tickets_left[pos] = tickets_left_of(event);
+    }
+
+    void clear() {
+        start.clear();
+        end.clear();
+        creator.clear();
+        tickets_left.clear();
+        for (auto& bits : flag_bits) {
+            bits.clear();
+        }
+        row_id.clear();
+        order.clear();
+        by_creator.clear();
+    }
+
+    // NO_CREATOR if the user never organized anything
+    uint32_t creator_id(const string& username) const {
+        auto it = creator_ids.find(username);
+        return it == creator_ids.end() ? NO_CREATOR : it->second;
+    }
+
+    // how many events a creator organized
+    size_t count_organized_by(uint32_t id) const {
+        auto it = by_creator.find(id);
+        return it == by_creator.end() ? 0 : it->second.size();
+    }
+
+    // positions of the events a creator organized, ascending
+    vector<size_t> organized_by(uint32_t id) const {
+        vector<size_t> positions;
+        auto it = by_creator.find(id);
+        if (it != by_creator.end()) {
+            positions.reserve(it->second.size());
+            for (uint32_t row : it->second) {
+                positions.push_back(order.position(row));
+            }
+        }
+        return positions;
+    }
+
+    // a stable id for the row at pos, see RowOrder
+    uint32_t row_id_of(size_t pos) const {
+        return row_id[pos];
+    }
+
+    // where the row with this id is now
+    size_t position_of(uint32_t id) const {
+        return order.position(id);
+    }
+
+    int64_t start_of(size_t pos) const {
+        return start[pos];
+    }
+
+    // events whose states match the query, counted off the bitsets
+    size_t count_flags(const EventQuery& query) const {
+        size_t count = 0;
+        for (size_t w = 0; w < flag_bits[0].word_count(); w++) {
+            count += __builtin_popcountll(flag_word(w, query));
+        }
+        return count;
+    }
+
+    // Whether the event at pos passes every predicate; creator is the query's interned
+    // organizer. An event whose tickets are not counted yet passes the tickets left test.
+    bool matches(size_t pos, const EventQuery& query, uint32_t creator_filter) const {
+        bool flags_ok = true;
+        for (int f = 0; f < EventQuery::FLAG_COUNT; f++) {
+            if ((query.flag_mask >> f) & 1) {
+                flags_ok &= flag_bits[f].test(pos) == (bool)((query.flag_value >> f) & 1);
+            }
+        }
+        return flags_ok & (start[pos] >= query.start_from) & (start[pos] <= query.start_to)
+            & ((tickets_left[pos] >= query.min_tickets_left) | (tickets_left[pos] == TICKETS_UNKNOWN))
+            & ((creator_filter == ANY_CREATOR) | (creator[pos] == creator_filter));
+    }
+
+    // Full pass over the columns in position order. The state bitsets rule out
+    // 64 events per word; the rest of the query is checked branch free on
+    // what is left, with the same caveat for uncounted tickets as matches().
+    vector<size_t> select(const EventQuery& query, uint32_t creator_filter) const {
+        vector<size_t> result;
+        bool any_creator = creator_filter == ANY_CREATOR;
+        for (size_t w = 0; w < flag_bits[0].word_count(); w++) {
+            uint64_t bits = flag_word(w, query);
+            while (bits) {
+                size_t i = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                bool keep = (start[i] >= query.start_from) & (start[i] <= query.start_to)
+                    & ((tickets_left[i] >= query.min_tickets_left) | (tickets_left[i] == TICKETS_UNKNOWN))
+                    & (any_creator | (creator[i] == creator_filter));
+                if (keep) {
+                    result.push_back(i);
+                }
+            }
+        }
+        return result;
+    }
+};
+
+#endif // EVENT_COLUMNS_HPP
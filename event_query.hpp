@@ -0,0 +1,91 @@
+#ifndef EVENT_QUERY_HPP
+#define EVENT_QUERY_HPP
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include "user.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// A conjunction of predicates over a Facility's events, built call by call:
+//
+//     EventQuery().organized_by("kaito").confirmed().starting_between(from, to)
+//
+// Facility::query() decides which of its indexes to start from.
+class EventQuery {
+public:
+    // event states, one bitset each in EventColumns
+    enum Flag : uint8_t {
+        CONFIRMED = 1,
+        PUBLIC = 2,
+        OPEN_TO_NON = 4,
+    };
+    static const int FLAG_COUNT = 3;
+
+    bool has_organizer = false;
+    string organizer;
+    uint8_t flag_mask = 0;  // states the query cares about
+    uint8_t flag_value = 0; // and what they must be
+    int64_t start_from = INT64_MIN; // epoch seconds, inclusive
+    int64_t start_to = INT64_MAX;
+    int min_tickets_left = 0;
+    bool by_start = false; // results in start time order instead of schedule order
+
+    EventQuery& organized_by(const string& username) {
+        has_organizer = true;
+        organizer = username;
+        return *this;
+    }
+
+    EventQuery& starting_between(const time_point<system_clock>& from, const time_point<system_clock>& to) {
+        start_from = duration_cast<seconds>(from.time_since_epoch()).count();
+        start_to = duration_cast<seconds>(to.time_since_epoch()).count();
+        return *this;
+    }
+
+    EventQuery& confirmed(bool value = true) {
+        return with_flag(CONFIRMED, value);
+    }
+
+    EventQuery& public_events(bool value = true) {
+        return with_flag(PUBLIC, value);
+    }
+
+    EventQuery& open_to_non(bool value = true) {
+        return with_flag(OPEN_TO_NON, value);
+    }
+
+    // public events this kind of user may attend: non-residents only those open to them
+    EventQuery& accessible_to(USER_TYPE type) {
+        public_events();
+        if (type == NON_RESIDENT) {
+            open_to_non();
+        }
+        return *this;
+    }
+
+    EventQuery& with_tickets_left(int at_least = 1) {
+        min_tickets_left = at_least;
+        return *this;
+    }
+
+    EventQuery& ordered_by_start() {
+        by_start = true;
+        return *this;
+    }
+
+    bool has_time_window() const {
+        return start_from != INT64_MIN || start_to != INT64_MAX;
+    }
+
+private:
+    EventQuery& with_flag(Flag flag, bool value) {
+        flag_mask |= flag;
+        flag_value = value ? (flag_value | flag) : (flag_value & ~flag);
+        return *this;
+    }
+};
+
+#endif // EVENT_QUERY_HPP
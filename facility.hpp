@@ -8,23 +8,61 @@
 #include <iostream>
 #include <chrono>
 #include <map>
+#include <unordered_map>
+#include <functional>
 #include "event.hpp"
+#include "metrics.hpp"
+#include "store.hpp"
+#include "interval_index.hpp"
+#include "event_columns.hpp"
+#include "calendar.hpp"
+#include "on_sale.hpp"
+#include "rcu.hpp"
+#include "schedule.hpp"
+#include "name_index.hpp"
 #include <iomanip>
 
 using namespace std;
 using namespace std::chrono;
 
+// a cancellation fee the facility kept, one line of the penalty ledger
+struct PenaltyRecord {
+    string event_name;
+    string organizer;
+    long long cancelled_at; // epoch seconds
+    double amount;
+};
+
+// events that a new reservation would displace under the override rule
+struct PreemptionPlan {
+    bool ok = false;
+    string reason;            // why the reservation cannot go ahead
+    vector<size_t> displaced; // positions in events
+};
+
 class Facility {
     vector<Event> events;
+    function<void(Event&)> waitlist_loader; // reads a deferred waitlist, see Event::defer_waitlist
+    IntervalIndex time_index; // events by start time, kept in step with events
+    EventColumns columns;     // queried fields and secondary indexes, row for row with events
+    unordered_map<string, vector<uint32_t>> rows_by_name; // name to the row ids of the events called that, ascending
+    NameIndex name_index;     // event names for lookups from part of a name
     double budget;  // Facility budget
+    double loaded_budget; // what was on disk when we started, saves merge the difference
+    vector<PenaltyRecord> penalties; // kept this session, the first penalties_saved are in the ledger
+    size_t penalties_saved = 0;
+    Rcu<Schedule> schedule;       // what the listings read
+    unordered_map<uint32_t, bool> schedule_changes; // row id -> whether its event is still there, since the last publish
+    bool schedule_reset = false;  // the row ids were handed out again, see reindex
+    uint64_t schedule_version = 0;
 public:
-    Facility() : budget(0.0) {
+    Facility() : budget(0.0), loaded_budget(0.0) {
         load_budget();
+        schedule.publish(make_unique<Schedule>()); // readers never find it empty
     }
 
     ~Facility() {
-        save_budget();
-        // No need to save events here as it's handled by the System
+        // Saving the budget and the events is handled by the System
     }
 
     // gets events vector
@@ -32,141 +70,315 @@ public:
         return events;
     }
 
-    // print each event in the schedule
-    void print_schedule(int days) {
+    void set_waitlist_loader(function<void(Event&)> loader) {
+        waitlist_loader = move(loader);
+    }
+
+    double get_budget() const {
+        return budget;
+    }
+
+    // the budget a checkpoint saved, later saves merge the difference from it
+    void set_loaded_budget(double saved) {
+        loaded_budget = saved;
+    }
+
+    // used when a merge with another session's changes refunds a payment
+    void adjust_budget(double delta) {
+        budget += delta;
+    }
+
+    // Makes the listings show the events as they are now, if they changed in a way
+    // the listings show since the last call. Runs under the System's lock; readers
+    // keep whichever version they started with.
+    void publish_schedule() {
+        if (schedule_changes.empty() && !schedule_reset) {
+            return;
+        }
+        Schedule::Changes changes;
+        for (const auto& change : schedule_changes) {
+            shared_ptr<const ScheduleRow> row;
+            if (change.second) {
+                const Event& event = events[columns.position_of(change.first)];
+                row = make_shared<const ScheduleRow>(ScheduleRow{event.get_name(), event.get_creator_username(),
+                    event.get_start_time(), event.get_end_time(), event.get_cost_to_attend(), event.get_meeting_style(),
+                    event.is_public(), event.is_open_to_non(), event.is_confirmed()});
+            }
+            changes.emplace_back(change.first, move(row));
+        }
+        schedule_changes.clear();
+        Rcu<Schedule>::Reader current(schedule);
+        const Schedule empty;
+        schedule.publish(make_unique<Schedule>(schedule_reset ? empty : *current, ++schedule_version, changes));
+        schedule_reset = false;
+    }
+
+    // print each event in the schedule; reads the published schedule, takes no lock
+    void print_schedule(int days) const {
+        print_schedule_page(days, SIZE_MAX, "");
+    }
+
+    // print_schedule a page at a time: up to page_size events after cursor ("" for the
+    // first page). Returns the cursor for the next page, "" after the last.
+    string print_schedule_page(int days, size_t page_size, const string& cursor) const {
         if (days < 1 || days > 14) {
             cout << "Please enter a number of days between 1 and 14.\n";
-            return;
+            return "";
         }
 
         auto now = chrono::system_clock::now();
-        auto end_time = now + chrono::hours(24 * days);
+        long long from = to_seconds(now);
+        long long to = to_seconds(now + chrono::hours(24 * days));
+
+        Rcu<Schedule>::Reader view(schedule);
+        string next;
+        // Display events, grouped by local day
+        int64_t current_day = INT64_MIN;
+        for (uint32_t row : view->page(view->confirmed, BY_START, page_size, cursor, next, from, to)) {
+            const ScheduleRow& event = view->row(row);
+            CivilTime start = Calendar::local(event.start);
+            int64_t day = Calendar::local_day(event.start);
+
+            if (day != current_day) {
+                current_day = day;
+                cout << "\nDay: " << Calendar::ymd(start) << "\n";
+            }
+
+            cout << "Event Name: " << event.name << "\n"
+                << "Organizer: " << event.organizer << "\n"
+                << "Start Time: " << Calendar::hm(start) << "\n"
+                << "End Time: " << Calendar::hm(Calendar::local(event.end)) << "\n"
+                << "Ticket Cost: $" << event.cost_to_attend << " per hour\n"
+                << "Room Setup/Meeting Style: " << to_string(static_cast<int>(event.style)) << "\n"
+                << "Other Details: " << (event.is_public ? "Public" : "Private") << ", "
+                << (event.open_to_non ? "Open to non-residents" : "Not open to non-residents") << "\n"
+                << "--------------------------\n";
+        }
+        return next;
+    }
 
-        vector<Event> filtered_events;
-        for (const Event& event : events) {
-            if (event.is_confirmed() && event.get_start_time() >= now && event.get_start_time() <= end_time) {
-                filtered_events.push_back(event);
+    // Positions in events of the events matching q. Starts from whichever index
+    // promises the fewest candidates: the organizer's event list, the start time
+    // index for a date window, or the state bitsets (a full pass when the query
+    // has no states); the rest of the query is checked per candidate.
+    vector<size_t> query(const EventQuery& q) const {
+        enum Plan { STATES, ORGANIZER, TIME };
+        Plan plan = STATES;
+        size_t best = q.flag_mask ? columns.count_flags(q) : events.size();
+        uint32_t creator = EventColumns::ANY_CREATOR;
+        if (q.has_organizer) {
+            creator = columns.creator_id(q.organizer);
+            if (columns.count_organized_by(creator) < best) {
+                best = columns.count_organized_by(creator);
+                plan = ORGANIZER;
+            }
+        }
+        if (q.has_time_window()) {
+            size_t in_window = time_index.count_starting_between(q.start_from, q.start_to, best);
+            if (in_window < best) {
+                best = in_window;
+                plan = TIME;
             }
         }
 
-        // Sort by start time
-        sort(filtered_events.begin(), filtered_events.end(),
-            [](const Event& a, const Event& b) {
-                return a.get_start_time() < b.get_start_time();
-            });
+        vector<size_t> result;
+        if (plan == STATES) {
+            result = columns.select(q, creator);
+        } else {
+            vector<size_t> candidates = plan == ORGANIZER ? columns.organized_by(creator)
+                : positions_of(time_index.starting_between(q.start_from, q.start_to));
+            for (size_t pos : candidates) {
+                if (columns.matches(pos, q, creator)) {
+                    result.push_back(pos);
+                }
+            }
+        }
 
-        // Display events, grouped by day
-        int current_day = -1;
-        for (const Event& event : filtered_events) {
-            auto event_time = event.get_start_time();
-            auto days_since_epoch = chrono::duration_cast<chrono::hours>(event_time.time_since_epoch()).count() / 24;
+        // events whose tickets were never parsed are counted now
+        if (q.min_tickets_left > 0) {
+            result.erase(remove_if(result.begin(), result.end(),
+                [&](size_t pos) { return events[pos].tickets_left() < q.min_tickets_left; }), result.end());
+        }
 
-            if (days_since_epoch != current_day) {
-                current_day = days_since_epoch;
-                time_t event_day_time_t = chrono::system_clock::to_time_t(event_time);
-                cout << "\nDay: " << put_time(localtime(&event_day_time_t), "%Y-%m-%d") << "\n";
-            }
+        // the time index hands out start time order, the others schedule order
+        if (q.by_start && plan != TIME) {
+            stable_sort(result.begin(), result.end(), [&](size_t a, size_t b) { return columns.start_of(a) < columns.start_of(b); });
+        } else if (!q.by_start && plan == TIME) {
+            sort(result.begin(), result.end());
+        }
+        return result;
+    }
 
-            time_t start_time_t = chrono::system_clock::to_time_t(event_time);
-            time_t end_time_t = chrono::system_clock::to_time_t(event.get_end_time());
-            cout << "Event Name: " << event.get_name() << "\n"
-                << "Organizer: " << event.get_creator_username() << "\n"
-                << "Start Time: " << put_time(localtime(&start_time_t), "%R") << "\n"
-                << "End Time: " << put_time(localtime(&end_time_t), "%R") << "\n"
-                << "Ticket Cost: $" << event.get_cost_to_attend() << " per hour\n"
-                << "Room Setup/Meeting Style: " << to_string(static_cast<int>(event.get_meeting_style())) << "\n"
-                << "Other Details: " << (event.is_public() ? "Public" : "Private") << ", "
-                << (event.is_open_to_non() ? "Open to non-residents" : "Not open to non-residents") << "\n"
-                << "--------------------------\n";
+    // finds an event by name, nullptr if there is none; the first one if the name is taken twice
+    Event* find_event(const string& event_name) {
+        auto it = rows_by_name.find(event_name);
+        if (it == rows_by_name.end()) {
+            return nullptr;
         }
+        return &events[columns.position_of(it->second.front())];
+    }
+
+    // removes an event without refunds or penalties, e.g. one that lost a merge with another session
+    void remove_event(const string& event_name) {
+        auto it = find_if(events.begin(), events.end(),
+            [&](const Event& e) { return e.get_name() == event_name; });
+        if (it != events.end()) {
+            erase_event(it - events.begin());
+        }
+    }
+
+    // adds what this session earned to whatever other sessions saved meanwhile;
+    // the caller holds the exclusive state lock
+    void save_budget() {
+        METRICS_SCOPE(M_SAVE_BUDGET);
+        double on_disk = 0;
+        ifstream file("facility_budget.txt");
+        if (file.is_open()) {
+            file >> on_disk;
+            file.close();
+        }
+        string out;
+        append_number(out, on_disk + (budget - loaded_budget));
+        write_file_atomically("facility_budget.txt", out);
+        budget = on_disk + (budget - loaded_budget);
+        loaded_budget = budget;
+    }
+
+    // appends this session's new penalties to the ledger; the caller holds the exclusive state lock
+    void save_penalties() {
+        string out;
+        for (size_t i = penalties_saved; i < penalties.size(); i++) {
+            const PenaltyRecord& record = penalties[i];
+            out += record.event_name;
+            out += ',';
+            out += record.organizer;
+            out += ',';
+            append_number(out, record.cancelled_at);
+            out += ',';
+            append_number(out, record.amount);
+            out += '\n';
+        }
+        if (out.empty() || append_to_file(PENALTY_LEDGER_FILE, out)) {
+            penalties_saved = penalties.size();
+        }
+    }
+
+    size_t get_penalties_saved() const {
+        return penalties_saved;
+    }
+
+    // a checkpoint already wrote the first count penalties
+    void set_penalties_saved(size_t count) {
+        penalties_saved = count;
+    }
+
+    // drops this session's unsaved penalty for event_name into amount; false if it has none
+    bool take_back_penalty(const string& event_name, double& amount) {
+        for (size_t i = penalties_saved; i < penalties.size(); i++) {
+            if (penalties[i].event_name == event_name) {
+                amount = penalties[i].amount;
+                penalties.erase(penalties.begin() + i);
+                return true;
+            }
+        }
+        return false;
     }
 
     //...ads events
     void add_event(const Event& event) {
         events.push_back(event);
+        on_event_added(events.size() - 1);
+    }
+
+    // Collects every event overlapping [start_time, end_time) and decides in one pass whether
+    // all of them can be overridden: only before their override lock (more than a week out),
+    // and only by a city-rate booking displacing a non-city one. Nothing changes until the
+    // plan is committed.
+    PreemptionPlan plan_reservation(const time_point<system_clock>& start_time, const time_point<system_clock>& end_time, double price_per_hour) const {
+        PreemptionPlan plan;
+        for (size_t pos : positions_of(time_index.overlapping(to_seconds(start_time), to_seconds(end_time)))) {
+            const Event& existing_event = events[pos];
+            if (existing_event.is_override_locked()) {
+                plan.reason = "Event time conflict, cannot schedule event.";
+                return plan;
+            }
+            if (Pricing::is_city_rate(existing_event.get_price_per_hour()) || !Pricing::is_city_rate(price_per_hour)) {
+                plan.reason = "Over a week in advance, will override if applicable.\nOverride not applicable.";
+                return plan;
+            }
+            plan.displaced.push_back(pos);
+        }
+        plan.ok = true;
+        return plan;
     }
 
     // making the reservation
-    bool make_reservation(const string& event_name, const string& creator_username, const time_point<system_clock>& start_time, const time_point<system_clock>& end_time, double price_per_hour, bool pubpriv, bool open_to_non, MeetingStyle style, double cost_to_attend, User* user, map<string, User> users) {
-        // Convert times to local time structure
-        time_t start_timet = system_clock::to_time_t(start_time);
-        time_t end_timet = system_clock::to_time_t(end_time);
-        struct tm *start_tm = localtime(&start_timet);
-        struct tm *end_tm = localtime(&end_timet);
+    bool make_reservation(const string& event_name, const string& creator_username, const time_point<system_clock>& start_time, const time_point<system_clock>& end_time, double price_per_hour, bool pubpriv, bool open_to_non, MeetingStyle style, double cost_to_attend, UserRegistry& users) {
+        int start_hour = Calendar::local(start_time).hour;
+        int end_hour = Calendar::local(end_time).hour;
 
-        int start_hour = start_tm->tm_hour;
-        int end_hour = end_tm->tm_hour;
+        // Check operational hours before anything is displaced
+        if (!Pricing::within_opening_hours(start_hour, end_hour)) {
+            cout << "Event must start after 9 AM and finish by 9 PM." << endl;
+            return false;
+        }
 
-        // Check for conflicts with existing events
-        for (const Event& existing_event : events) {
-            if ((start_time < existing_event.get_end_time() && end_time > existing_event.get_start_time()) ||
-                start_time == existing_event.get_start_time()) {
-                system_clock::time_point now = system_clock::now();
-                if (duration_cast<seconds>(existing_event.get_start_time() - now).count() / (60*60*24) > 7) {
-                    cout << "Over a week in advance, will override if applicable.\n";
-                    if (existing_event.get_price_per_hour() == 5 || price_per_hour != 5) {
-                        cout << "Override not applicable.\n";
-                        return false;
-                    } else {
-                        cout << "Overriding current event reservation.\n";
-                        cancel_event(existing_event.get_name(), user, users);
-                        break;
-                    }
-                } else {
-                    cout << "Event time conflict, cannot schedule event." << endl;
-                    return false;
-                }
-            }
+        // Saving, merging and waitlists all go by name, so two live events cannot share one
+        if (find_event(event_name)) {
+            cout << "There is already an event called " << event_name << "." << endl;
+            return false;
         }
 
-        // Check operational hours
-        if (start_hour < 9 || end_hour >= 21) {
-            cout << "Event must start after 9 AM and finish by 9 PM." << endl;
+        // Check for conflicts with existing events
+        PreemptionPlan plan = plan_reservation(start_time, end_time, price_per_hour);
+        if (!plan.ok) {
+            cout << plan.reason << endl;
             return false;
         }
 
-        // If all checks pass, add the event
+        // If all checks pass, displace the conflicts and add the event as one unit
         Event new_event(event_name, creator_username, start_time, end_time, price_per_hour, pubpriv, open_to_non, style, cost_to_attend);
-        events.push_back(new_event);
+        commit_reservation(plan, new_event, users);
         cout << "Event successfully scheduled." << endl;
         return true;
     }
 
-
-    // Method to display events organized by a specific user
-    void display_events_by_organizer(const string& organizer_username) {
-        bool found = false;
+    // Method to display events organized by a specific user; reads the published schedule
+    void display_events_by_organizer(const string& organizer_username) const {
         cout << "Events organized by " << organizer_username << ":\n";
-        for (const auto& event : events) {
-            if (event.get_creator_username() == organizer_username) {
-                found = true;
-                // Convert time_point to time_t then to tm struct for formatting
-                auto start_time_t = std::chrono::system_clock::to_time_t(event.get_start_time());
-                auto end_time_t = std::chrono::system_clock::to_time_t(event.get_end_time());
-                auto start_tm = *std::localtime(&start_time_t);
-                auto end_tm = *std::localtime(&end_time_t);
-
-                cout << "Event Name: " << event.get_name() << "\n"
-                    << "Date: " << std::put_time(&start_tm, "%m-%d-%Y") << "\n"
-                    << "Start Time: " << std::put_time(&start_tm, "%H:%M") << "\n"
-                    << "Duration: " << std::chrono::duration_cast<std::chrono::hours>(event.get_end_time() - event.get_start_time()).count() << " hour(s)\n"
-                    << "Meeting Style: " << static_cast<int>(event.get_meeting_style()) << "\n" // Consider translating enum to string
-                    << "Public/Private: " << (event.is_public() ? "Public" : "Private") << "\n"
-                    << "Open to Non-residents: " << (event.is_open_to_non() ? "Yes" : "No") << "\n"
-                    << "Confirmed: " << (event.is_confirmed() ? "Yes" : "No") << "\n"
-                    << "--------------------------\n";
-            }
+        Rcu<Schedule>::Reader view(schedule);
+        const SharedSortedList<uint32_t>& organized = view->organized_by(organizer_username).in_order;
+        for (uint32_t row : organized) {
+            print_organized(view->row(row));
         }
-        if (!found) {
+        if (organized.empty()) {
             cout << "No events found for " << organizer_username << ".\n";
         }
     }
 
+    // display_events_by_organizer a page at a time, sorted by order; see print_schedule_page
+    string display_events_by_organizer_page(const string& organizer_username, ListingOrder order, size_t page_size,
+                                            const string& cursor) const {
+        if (cursor.empty()) {
+            cout << "Events organized by " << organizer_username << ":\n";
+        }
+        Rcu<Schedule>::Reader view(schedule);
+        string next;
+        vector<uint32_t> rows = view->page(view->organized_by(organizer_username), order, page_size, cursor, next);
+        for (uint32_t row : rows) {
+            print_organized(view->row(row));
+        }
+        if (rows.empty() && cursor.empty()) {
+            cout << "No events found for " << organizer_username << ".\n";
+        }
+        return next;
+    }
+
     //returns event_cost
     double get_event_cost(const string& event_name) {
         for (const auto& event : events) {
             if (event.get_name() == event_name && !event.is_confirmed()) {
-                return event.calculate_total_cost() + 10; // Adding $10 service charge
+                return event.amount_due();
             }
         }
         return -1; // Indicates the event was not found or already confirmed
@@ -174,13 +386,16 @@ public:
 
     //processes payment logic
     bool process_payment(const string& event_name, User* user, double amount_paid) {
-        for (auto& event : events) {
+        for (size_t pos = 0; pos < events.size(); pos++) {
+            Event& event = events[pos];
             if (event.get_name() == event_name) {
-                double total_cost = event.calculate_total_cost() + 10; // Including $10 service charge
+                double total_cost = event.amount_due();
                 if (!event.is_confirmed() && user->get_bank_balance() >= amount_paid && amount_paid >= total_cost) {
                     user->set_bank_balance(user->get_bank_balance() - amount_paid); // Deduct the amount
                     budget+= amount_paid;
                     event.confirm(); // Confirm the event
+                    on_event_changed(pos);
+                    schedule_changes[columns.row_id_of(pos)] = true;
                     return true;
                 } else {
                     return false; // Payment failed due to insufficient funds or incorrect amount
@@ -203,6 +418,7 @@ public:
                     return false;
                 }
                 if (!event.has_tickets()) {
+                    load_waitlist(event);
                     event.join_waitlist(user);
                     return false;
                 }
@@ -213,25 +429,38 @@ public:
         return false;
     }
 
-    //displays all events availabel to a specific user
-    void display_available_events (User* currentUser) {
-        for (const Event& event : events) {
-            if (event.is_public() && !(currentUser->get_user_type() == 2 && !event.is_open_to_non()) && event.is_confirmed()) {
-                    auto start_time_t = std::chrono::system_clock::to_time_t(event.get_start_time());
-               
-                    auto start_tm = *std::localtime(&start_time_t);
-            cout << "Event name: " << event.get_name() << ", Date: " << std::put_time(&start_tm, "%m-%d-%Y")
-                << ", Start Time: " << std::put_time(&start_tm, "%H:%M") << endl;
-            }
+    //displays all events availabel to a specific user; reads the published schedule
+    void display_available_events (const User* currentUser) const {
+        Rcu<Schedule>::Reader view(schedule);
+        for (uint32_t row : available(*view, currentUser).in_order) {
+            print_available(view->row(row));
         }
     }
 
+    // display_available_events a page at a time, sorted by order; see print_schedule_page
+    string display_available_events_page(const User* currentUser, ListingOrder order, size_t page_size,
+                                         const string& cursor) const {
+        Rcu<Schedule>::Reader view(schedule);
+        string next;
+        for (uint32_t row : view->page(available(*view, currentUser), order, page_size, cursor, next)) {
+            print_available(view->row(row));
+        }
+        return next;
+    }
+
 
     //buys ticket and returns true if done, 
-    bool buy_ticket(const string& event_name, User* user) {
-        for (auto& event : events) {
-            if (event.get_name() == event_name) {
-                return event.purchase_ticket(user);
+    bool buy_ticket(const string& event_name, User* user, int count = 1) {
+        for (size_t pos = 0; pos < events.size(); pos++) {
+            if (events[pos].get_name() == event_name) {
+                Event& event = events[pos];
+                bool bought = event.purchase_tickets(user, count);
+                if (!bought && user->get_bank_balance() >= event.get_cost_to_attend() * count) {
+                    load_waitlist(event); // there was money for it, just no block of seats
+                    event.join_waitlist(user);
+                }
+                on_event_changed(pos);
+                return bought;
             }
         }
         // should never reach here
@@ -239,19 +468,30 @@ public:
     }
 
     // pays event organizers for purchaseed tickets
-    void pay_organizer(const string& event_name, User* user, map<string, User> users) {
-        string username = user->get_user_name();
+    void pay_organizer(const string& event_name, UserRegistry& users, int count = 1) {
         for (auto& event : events) {
             if (event.get_name() == event_name) {
-                if (users.find(username) != users.end()) {
-                    User organizer = users[username];
+                if (User* organizer = users.find(event.get_creator_username())) {
                     cout << "Paid the organizer\n";
-                    organizer.get_payment(event.get_cost_to_attend());
+                    organizer->get_payment(event.get_cost_to_attend() * count);
                 }
+                return;
             }
         }
     }
  
+    // every event's name, for finding one from part of it
+    const NameIndex& get_name_index() const {
+        return name_index;
+    }
+
+    // whether user can buy tickets to the event, as display_available_events lists them
+    bool available_to(const string& event_name, const User* user) {
+        const Event* event = find_event(event_name);
+        return event && event->is_confirmed() && event->is_public()
+            && (user->get_user_type() != NON_RESIDENT || event->is_open_to_non());
+    }
+
     // finds a ticket for a user
     bool find_ticket(const string& event_name, User* user) {
         for (auto& event : events) {
@@ -263,35 +503,33 @@ public:
     }
 
     //cancels a ticket for a user
-    void cancel_ticket(const string& event_name, User* user) {
-        for (auto& event : events) {
-            if (event.get_name() == event_name) {
-                event.cancel_users_ticket(user->get_user_name());
+    void cancel_ticket(const string& event_name, User* user, UserRegistry& users) {
+        for (size_t pos = 0; pos < events.size(); pos++) {
+            if (events[pos].get_name() == event_name) {
+                load_waitlist(events[pos]); // a freed ticket goes to the waitlist
+                events[pos].cancel_users_ticket(user->get_user_name(), users);
+                on_event_changed(pos);
             }
         }
     }
 
     // cancells event, refunds everyone
-    bool cancel_event(string event_name, User* user, map<string, User> users){
+    bool cancel_event(string event_name, User* user, UserRegistry& users){
         auto it = find_if(events.begin(), events.end(),
             [&](const Event& e) { return e.get_name() == event_name; });
         
-        for (auto& event : events) { // refund purchased tickets if any
-            if (event.get_name() == event_name) {
-                event.cancel_all_tickets(users);
-            }
-        }
         if (it != events.end()) {
-            // Calculate penalty if within 7 days from start
-            system_clock::time_point now = system_clock::now();
-            double penalty = 10;
-            double event_cost = get_event_cost(it->get_name());
-            if (duration_cast<seconds>(it->get_start_time() - now).count() / (60*60*24) < 7) {
-                penalty += 0.01 * event_cost;  // Assuming rent_amount or similar can be fetched
-            }     
-            user->set_bank_balance(user->get_bank_balance() + event_cost - penalty);
-            budget += penalty;
-            events.erase(it);
+            it->cancel_all_tickets(users); // refund purchased tickets if any
+            // Refund what was paid for the reservation, minus the penalty
+            if (it->is_confirmed()) {
+                system_clock::time_point now = system_clock::now();
+                double paid = it->amount_due();
+                double penalty = Pricing::cancellation_penalty(paid, it->is_late_cancellation());
+                user->set_bank_balance(user->get_bank_balance() + paid - penalty);
+                budget -= paid - penalty;
+                penalties.push_back({it->get_name(), it->get_creator_username(), to_seconds(now), penalty});
+            }
+            erase_event(it - events.begin());
             cout << "Event canceled with applicable penalties." << endl;
             return true;
         } else {
@@ -300,23 +538,212 @@ public:
         return false;
     }
 
+    // An unpaid reservation whose start came: its tickets are refunded and the slot freed,
+    // with no penalty since nothing was paid. False if it was paid for after all.
+    bool expire_hold(const string& event_name, UserRegistry& users) {
+        Event* event = find_event(event_name);
+        if (!event || event->is_confirmed()) {
+            return false;
+        }
+        cout << "Reservation " << event_name << " was never paid for and has expired.\n";
+        event->cancel_all_tickets(users);
+        erase_event(event - events.data());
+        return true;
+    }
+
+    // the event started: whoever is still waiting will not get a seat
+    void close_waitlist(Event& event) {
+        load_waitlist(event); // so the save knows who to take off the file
+        event.close_waitlist();
+    }
+
+    // One round of an on-sale event's queue, in arrival order. Buyers pay for
+    // their own seats as they get them; the organizer is paid and the indexes
+    // updated once for the round. Returns how many requests were settled.
+    size_t settle_sale(OnSale& sale, UserRegistry& users) {
+        vector<OnSale::Request> batch = sale.take_batch();
+        auto it = find_if(events.begin(), events.end(),
+            [&](const Event& e) { return e.get_name() == sale.get_event_name(); });
+        if (it == events.end()) {
+            for (OnSale::Request& request : batch) {
+                request.outcome.set_value(SALE_FAILED);
+            }
+            return batch.size();
+        }
+        Event& event = *it;
+        double takings = 0;
+        for (OnSale::Request& request : batch) {
+            User* user = request.user;
+            double price = event.get_cost_to_attend() * request.count;
+            if (request.admitted && user->get_bank_balance() < price) {
+                sale.give_back(request);
+                request.outcome.set_value(SALE_FAILED);
+                continue;
+            }
+            if (request.admitted && event.assign_block(user, request.count) >= 0) {
+                user->set_bank_balance(user->get_bank_balance() - price);
+                takings += price;
+                request.outcome.set_value(SALE_BOUGHT);
+                continue;
+            }
+            // turned away at the door, or no seats together after all
+            sale.give_back(request);
+            load_waitlist(event);
+            request.outcome.set_value(event.join_waitlist(user) ? SALE_WAITLISTED : SALE_FAILED);
+        }
+        User* organizer = users.find(event.get_creator_username());
+        if (organizer && takings > 0) {
+            organizer->get_payment(takings);
+        }
+        if (!batch.empty()) {
+            on_event_changed(it - events.begin());
+        }
+        return batch.size();
+    }
+
 private:
+    static long long to_seconds(const time_point<system_clock>& t) {
+        return duration_cast<seconds>(t.time_since_epoch()).count();
+    }
+
+    static const Schedule::Listing& available(const Schedule& view, const User* user) {
+        return user->get_user_type() == NON_RESIDENT ? view.open_to_non : view.open;
+    }
+
+    static void print_available(const ScheduleRow& event) {
+        CivilTime start = Calendar::local(event.start);
+        cout << "Event name: " << event.name << ", Date: " << Calendar::mdy(start)
+            << ", Start Time: " << Calendar::hm(start) << endl;
+    }
+
+    static void print_organized(const ScheduleRow& event) {
+        CivilTime start = Calendar::local(event.start);
+        cout << "Event Name: " << event.name << "\n"
+            << "Date: " << Calendar::mdy(start) << "\n"
+            << "Start Time: " << Calendar::hm(start) << "\n"
+            << "Duration: " << std::chrono::duration_cast<std::chrono::hours>(event.end - event.start).count() << " hour(s)\n"
+            << "Meeting Style: " << static_cast<int>(event.style) << "\n" // Consider translating enum to string
+            << "Public/Private: " << (event.is_public ? "Public" : "Private") << "\n"
+            << "Open to Non-residents: " << (event.open_to_non ? "Yes" : "No") << "\n"
+            << "Confirmed: " << (event.confirmed ? "Yes" : "No") << "\n"
+            << "--------------------------\n";
+    }
+
+    void load_waitlist(Event& event) {
+        if (!event.waitlist_loaded() && waitlist_loader) {
+            waitlist_loader(event);
+        }
+    }
+
+    void erase_event(size_t pos) {
+        name_index.erase(events[pos].get_name());
+        schedule_changes[columns.row_id_of(pos)] = false;
+        auto rows = rows_by_name.find(events[pos].get_name());
+        rows->second.erase(find(rows->second.begin(), rows->second.end(), columns.row_id_of(pos)));
+        if (rows->second.empty()) {
+            rows_by_name.erase(rows);
+        }
+        time_index.erase(to_seconds(events[pos].get_start_time()), columns.row_id_of(pos));
+        events.erase(events.begin() + pos);
+        columns.erase(pos);
+    }
+
+    // keep the indexes in step with events
+    void on_event_added(size_t pos) {
+        name_index.insert(events[pos].get_name());
+        columns.append(events[pos]);
+        time_index.insert(to_seconds(events[pos].get_start_time()), to_seconds(events[pos].get_end_time()), columns.row_id_of(pos));
+        rows_by_name[events[pos].get_name()].push_back(columns.row_id_of(pos)); // ids only grow
+        schedule_changes[columns.row_id_of(pos)] = true;
+    }
+
+    // where the events with these row ids are now, in the same order
+    vector<size_t> positions_of(const vector<uint32_t>& rows) const {
+        vector<size_t> positions;
+        positions.reserve(rows.size());
+        for (uint32_t row : rows) {
+            positions.push_back(columns.position_of(row));
+        }
+        return positions;
+    }
+
+    void on_event_changed(size_t pos) {
+        columns.update(pos, events[pos]);
+    }
+
+    void reindex() {
+        time_index.clear();
+        columns.clear();
+        rows_by_name.clear();
+        name_index.clear();
+        schedule_changes.clear();
+        schedule_reset = true; // the next version starts over with the new ids
+        for (size_t pos = 0; pos < events.size(); pos++) {
+            on_event_added(pos);
+        }
+    }
+
+    // Applies a plan: displaced organizers get back what they paid (the facility broke the
+    // booking, so no penalty), their ticket holders are refunded, then the new event goes in.
+    // If anything fails part way, events, balances and the budget go back to how they were.
+    void commit_reservation(const PreemptionPlan& plan, const Event& new_event, UserRegistry& users) {
+        vector<pair<size_t, Event>> removed; // in the order they were erased
+        map<User*, User> saved_users;
+        double saved_budget = budget;
+        size_t original_size = events.size();
+        try {
+            vector<size_t> displaced = plan.displaced;
+            sort(displaced.rbegin(), displaced.rend()); // erase from the back so positions stay valid
+            for (size_t pos : displaced) {
+                Event& old_event = events[pos];
+                cout << "Overriding current event reservation: " << old_event.get_name() << "\n";
+                User* organizer = users.find(old_event.get_creator_username());
+                if (organizer && !saved_users.count(organizer)) {
+                    saved_users.emplace(organizer, *organizer);
+                }
+                for (const string& name : old_event.holder_names()) {
+                    User* holder = users.find(name);
+                    if (holder && !saved_users.count(holder)) {
+                        saved_users.emplace(holder, *holder); // refunded and stripped of the tickets below
+                    }
+                }
+                removed.emplace_back(pos, old_event);
+                if (old_event.is_confirmed() && organizer) {
+                    organizer->get_payment(old_event.amount_due());
+                    budget -= old_event.amount_due();
+                }
+                old_event.cancel_all_tickets(users);
+                erase_event(pos);
+            }
+            events.push_back(new_event);
+            on_event_added(events.size() - 1);
+        } catch (...) {
+            if (events.size() + removed.size() > original_size) {
+                events.pop_back(); // the new event made it in
+            }
+            for (auto it = removed.rbegin(); it != removed.rend(); ++it) {
+                events.insert(events.begin() + it->first, it->second);
+            }
+            for (auto& pair : saved_users) {
+                *pair.first = pair.second;
+            }
+            budget = saved_budget;
+            reindex();
+            throw;
+        }
+    }
+
 //for saving and loading budget
 void load_budget() {
+        METRICS_SCOPE(M_LOAD_BUDGET);
         ifstream file("facility_budget.txt");
         if (file.is_open()) {
             file >> budget;
             file.close();
         }
+        loaded_budget = budget;
     }
 
-    void save_budget() const {
-        ofstream file("facility_budget.txt");
-        if (file.is_open()) {
-            file << budget;
-            file.close();
-        }
-    }
 
 };
 
@@ -0,0 +1,77 @@
+#ifndef INTERVAL_INDEX_HPP
+#define INTERVAL_INDEX_HPP
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+// Events ordered by start time, answering "what overlaps [start, end)"
+// without a full scan. Entries hold the event's stable row id from
+// EventColumns, which erasing the rows in front of it leaves alone, so an
+// erase only takes out its own entry. Times are epoch seconds.
+class IntervalIndex {
+    struct Entry {
+        long long end;
+        uint32_t row;
+    };
+    multimap<long long, Entry> by_start;
+    long long longest = 0; // longest event seen, bounds how far back an overlap can start
+
+public:
+    void insert(long long start, long long end, uint32_t row) {
+        by_start.insert(make_pair(start, Entry{end, row}));
+        longest = max(longest, end - start);
+    }
+
+    // the event with this row id, which starts at start, was erased
+    void erase(long long start, uint32_t row) {
+        auto range = by_start.equal_range(start);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.row == row) {
+                by_start.erase(it);
+                return;
+            }
+        }
+    }
+
+    void clear() {
+        by_start.clear();
+        longest = 0;
+    }
+
+    // row ids of events starting in [from, to], by start time, at most limit of them
+    vector<uint32_t> starting_between(long long from, long long to, size_t limit = SIZE_MAX) const {
+        vector<uint32_t> result;
+        for (auto it = by_start.lower_bound(from); it != by_start.end() && it->first <= to && result.size() < limit; ++it) {
+            result.push_back(it->second.row);
+        }
+        return result;
+    }
+
+    // how many events start in [from, to], counting no further than limit
+    size_t count_starting_between(long long from, long long to, size_t limit = SIZE_MAX) const {
+        size_t count = 0;
+        for (auto it = by_start.lower_bound(from); it != by_start.end() && it->first <= to && count < limit; ++it) {
+            count++;
+        }
+        return count;
+    }
+
+    // row ids of events overlapping [start, end) or starting at the same time, by start time
+    vector<uint32_t> overlapping(long long start, long long end) const {
+        vector<uint32_t> result;
+        auto it = by_start.lower_bound(start - longest);
+        auto stop = by_start.upper_bound(max(start, end - 1));
+        for (; it != stop; ++it) {
+            if ((start < it->second.end && end > it->first) || start == it->first) {
+                result.push_back(it->second.row);
+            }
+        }
+        return result;
+    }
+};
+
+#endif // INTERVAL_INDEX_HPP
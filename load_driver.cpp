@@ -0,0 +1,217 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <unistd.h>
+#include "system.hpp"
+#include "bench_support.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Closed-loop load driver: N client threads each log in as a user and run a
+// mixed browse/reserve/pay/buy/cancel profile against one System, recording
+// the latency of every call. Point it at a directory made by workload_gen.
+//
+// usage: ./load_driver <data_dir> [threads] [ops_per_thread] [seed]
+
+enum Op { BROWSE, RESERVE, PAY, BUY, CANCEL, NUM_OPS };
+static const char* op_names[NUM_OPS] = {"browse", "reserve", "pay", "buy", "cancel"};
+static const int op_weights[NUM_OPS] = {40, 15, 10, 25, 10}; // percent
+
+struct OpStats {
+    vector<long long> latencies_ns;
+    long long ok = 0;
+};
+
+struct ClientResult {
+    OpStats ops[NUM_OPS];
+};
+
+// one client; it goes through system_lock except to browse, which reads the
+// published schedule
+static void run_client(System& system, int id, const string& username, const vector<string>& public_events,
+                       time_t first_day, int num_ops, unsigned seed, ClientResult& result) {
+    mt19937 rng(seed + id);
+    User* user;
+    {
+        lock_guard<mutex> guard(system_lock);
+        user = system.login_user(username);
+    }
+    deque<string> pending_reservations; // reserved but not paid for yet
+    vector<string> confirmed_reservations;
+    vector<string> bought;
+    int reservation_count = 0;
+
+    for (int i = 0; i < num_ops; i++) {
+        int roll = rng() % 100;
+        int op = 0;
+        while (roll >= op_weights[op]) {
+            roll -= op_weights[op];
+            op++;
+        }
+        // fall back to a reservation when there is nothing to pay for
+        if (op == PAY && pending_reservations.empty()) {
+            op = RESERVE;
+        }
+
+        string event_name;
+        bool own_event = false; // cancelling our own reservation rather than a ticket
+        time_point<system_clock> start_time;
+        int duration = 1 + rng() % 3;
+        bool pubpriv = rng() % 2, open_to_non = rng() % 2;
+        MeetingStyle style = static_cast<MeetingStyle>(rng() % 4);
+        int count = 1;
+        if (op == RESERVE) {
+            event_name = "load " + to_string(id) + "-" + to_string(reservation_count++);
+            start_time = system_clock::from_time_t(first_day) + hours(24 * (1 + rng() % 730) + 9 + rng() % 9);
+        } else if (op == PAY) {
+            event_name = pending_reservations.front();
+            pending_reservations.pop_front();
+        } else if (op == BUY && !public_events.empty()) {
+            event_name = public_events[rng() % public_events.size()];
+            count = rng() % 5 == 0 ? 2 + rng() % 3 : 1; // some group bookings
+        } else if (op == CANCEL) {
+            if (!bought.empty()) {
+                event_name = bought.back();
+                bought.pop_back();
+            } else if (!confirmed_reservations.empty()) {
+                event_name = confirmed_reservations.back();
+                confirmed_reservations.pop_back();
+                own_event = true;
+            }
+        }
+
+        bool ok = false;
+        auto begin = steady_clock::now();
+        if (op == BROWSE) {
+            system.browse_events(user);
+            ok = true;
+        } else {
+            lock_guard<mutex> guard(system_lock);
+            switch (op) {
+                case BROWSE:
+                    break;
+                case RESERVE:
+                    ok = system.reserve_event(user, event_name, start_time, duration, pubpriv, open_to_non, style, pubpriv ? 10 : 0);
+                    break;
+                case PAY:
+                    ok = system.pay_for_event(user, event_name);
+                    break;
+                case BUY:
+                    ok = system.buy_ticket(user, event_name, count);
+                    break;
+                case CANCEL:
+                    if (own_event) {
+                        ok = system.cancel_event(user, event_name);
+                    } else if (!event_name.empty()) {
+                        ok = system.cancel_ticket(user, event_name);
+                    }
+                    break;
+            }
+        }
+        auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+        result.ops[op].latencies_ns.push_back(elapsed);
+
+        if (ok) {
+            result.ops[op].ok++;
+            if (op == RESERVE) {
+                pending_reservations.push_back(event_name);
+            } else if (op == PAY) {
+                confirmed_reservations.push_back(event_name);
+            } else if (op == BUY) {
+                bought.push_back(event_name);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <data_dir> [threads] [ops_per_thread] [seed]\n";
+        return 1;
+    }
+    int num_threads = argc > 2 ? stoi(argv[2]) : 4;
+    int ops_per_thread = argc > 3 ? stoi(argv[3]) : 10000;
+    unsigned seed = argc > 4 ? stoul(argv[4]) : 1;
+    if (chdir(argv[1]) != 0) {
+        cerr << "cannot enter data directory " << argv[1] << "\n";
+        return 1;
+    }
+
+    // the System entry points talk to the terminal, keep that out of the report
+    NullBuffer discard;
+    streambuf* console = cout.rdbuf(&discard);
+
+    auto load_begin = steady_clock::now();
+    unique_ptr<System> system(new System());
+    double load_ms = duration_cast<microseconds>(steady_clock::now() - load_begin).count() / 1000.0;
+
+    vector<string> usernames;
+    for (const User* user : system->get_users().by_name()) {
+        usernames.push_back(user->get_user_name());
+    }
+    vector<string> public_events;
+    Facility& facility = system->get_facility();
+    for (size_t pos : facility.query(EventQuery().public_events().confirmed())) {
+        public_events.push_back(facility.get_events()[pos].get_name());
+    }
+    if (usernames.empty()) {
+        cout.rdbuf(console);
+        cerr << "no users in " << argv[1] << ", run workload_gen first\n";
+        return 1;
+    }
+
+    CivilTime today = Calendar::local(time(nullptr));
+    time_t first_day = Calendar::to_utc(today.year, today.month, today.day);
+
+    vector<ClientResult> results(num_threads);
+    vector<thread> clients;
+    auto run_begin = steady_clock::now();
+    for (int i = 0; i < num_threads; i++) {
+        clients.emplace_back(run_client, ref(*system), i, usernames[i % usernames.size()], cref(public_events),
+                             first_day, ops_per_thread, seed, ref(results[i]));
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double run_s = duration_cast<microseconds>(steady_clock::now() - run_begin).count() / 1e6;
+
+    auto save_begin = steady_clock::now();
+    system.reset();
+    double save_ms = duration_cast<microseconds>(steady_clock::now() - save_begin).count() / 1000.0;
+    cout.rdbuf(console);
+
+    cout << "load: " << fixed << setprecision(1) << load_ms << " ms, save: " << save_ms << " ms\n";
+    cout << "threads: " << num_threads << ", ops: " << (long long)num_threads * ops_per_thread
+        << ", elapsed: " << setprecision(3) << run_s << " s, throughput: "
+        << setprecision(0) << num_threads * ops_per_thread / run_s << " ops/s\n\n";
+    cout << left << setw(10) << "op" << right << setw(10) << "count" << setw(10) << "ok"
+        << setw(12) << "ops/s" << setw(12) << "p50(us)" << setw(12) << "p99(us)" << setw(12) << "p999(us)" << setw(12) << "max(us)" << "\n";
+    for (int op = 0; op < NUM_OPS; op++) {
+        vector<long long> all;
+        long long ok = 0;
+        for (const auto& result : results) {
+            all.insert(all.end(), result.ops[op].latencies_ns.begin(), result.ops[op].latencies_ns.end());
+            ok += result.ops[op].ok;
+        }
+        sort(all.begin(), all.end());
+        cout << left << setw(10) << op_names[op] << right << setw(10) << all.size() << setw(10) << ok
+            << setw(12) << setprecision(0) << all.size() / run_s
+            << setprecision(1) << setw(12) << percentile_us(all, 0.50) << setw(12) << percentile_us(all, 0.99)
+            << setw(12) << percentile_us(all, 0.999) << setw(12) << (all.empty() ? 0 : all.back() / 1000.0) << "\n";
+    }
+#ifdef EVENT_METRICS
+    cout << "\nSystem metrics (also written to stats.txt):\n";
+    Metrics::dump(cout);
+#endif
+    return 0;
+}
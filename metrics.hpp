@@ -0,0 +1,232 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// Per-operation counters and latency histograms for the System entry points
+// and the load/save phases. Build with -DEVENT_METRICS (make METRICS=1) to
+// turn them on; otherwise METRICS_SCOPE expands to nothing.
+
+enum Metric {
+    M_PROCESS_RESERVATION,
+    M_PROCESS_PAYMENT,
+    M_BUY_TICKET,
+    M_CANCEL_TICKET,
+    M_CANCEL_EVENT,
+    M_LOAD_USERS,
+    M_LOAD_EVENTS,
+    M_LOAD_WAITLISTS,
+    M_LOAD_BUDGET,
+    M_SAVE_USERS,
+    M_SAVE_EVENTS,
+    M_SAVE_WAITLISTS,
+    M_SAVE_BUDGET,
+    NUM_METRICS
+};
+
+static const char* const metric_names[NUM_METRICS] = {
+    "process_reservation", "process_payment", "buy_ticket", "cancel_ticket", "cancel_event",
+    "load_users", "load_events", "load_waitlists", "load_budget",
+    "save_users", "save_events", "save_waitlists", "save_budget"
+};
+
+// HDR style log-linear histogram over nanoseconds: one group of 16 linear
+// sub-buckets per power of two, so every bucket is within 1/16 of its value.
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int GROUPS = 64 - SUB_BITS + 1;
+    static const int NUM_BUCKETS = GROUPS * SUB_BUCKETS;
+
+    uint64_t counts[NUM_BUCKETS] = {};
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    static int bucket_of(uint64_t ns) {
+        if (ns < SUB_BUCKETS) {
+            return (int)ns;
+        }
+        int msb = 63 - __builtin_clzll(ns);
+        int group = msb - SUB_BITS + 1;
+        int sub = (int)(ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return group * SUB_BUCKETS + sub;
+    }
+
+    // largest value that lands in the bucket
+    static uint64_t bucket_value(int bucket) {
+        int group = bucket / SUB_BUCKETS;
+        uint64_t sub = bucket % SUB_BUCKETS;
+        if (group == 0) {
+            return sub;
+        }
+        int shift = group - 1;
+        return (((SUB_BUCKETS | sub) + 1) << shift) - 1;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        count += other.count;
+        total_ns += other.total_ns;
+        if (other.max_ns > max_ns) {
+            max_ns = other.max_ns;
+        }
+    }
+
+    uint64_t percentile(double p) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * count);
+        if (rank >= count) {
+            rank = count - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                uint64_t value = bucket_value(i);
+                return value < max_ns ? value : max_ns;
+            }
+        }
+        return max_ns;
+    }
+};
+
+class Metrics {
+    // one shard per thread, written only by its owner with relaxed stores so
+    // readers can take a snapshot at any time without stopping anybody
+    struct Shard {
+        atomic<uint64_t> counts[NUM_METRICS][LatencyHistogram::NUM_BUCKETS];
+        atomic<uint64_t> total_ns[NUM_METRICS];
+        atomic<uint64_t> max_ns[NUM_METRICS];
+
+        Shard() {
+            for (int m = 0; m < NUM_METRICS; m++) {
+                for (auto& c : counts[m]) {
+                    c.store(0, memory_order_relaxed);
+                }
+                total_ns[m].store(0, memory_order_relaxed);
+                max_ns[m].store(0, memory_order_relaxed);
+            }
+        }
+    };
+
+    mutex shards_lock;
+    vector<unique_ptr<Shard>> shards; // kept after their thread exits so nothing is lost
+
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    static Shard& local_shard() {
+        thread_local Shard* shard = nullptr;
+        if (!shard) {
+            Metrics& m = instance();
+            lock_guard<mutex> guard(m.shards_lock);
+            m.shards.emplace_back(new Shard());
+            shard = m.shards.back().get();
+        }
+        return *shard;
+    }
+
+    static void bump(atomic<uint64_t>& a, uint64_t by) {
+        a.store(a.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+public:
+    static void record(Metric metric, uint64_t ns) {
+        Shard& shard = local_shard();
+        bump(shard.counts[metric][LatencyHistogram::bucket_of(ns)], 1);
+        bump(shard.total_ns[metric], ns);
+        if (ns > shard.max_ns[metric].load(memory_order_relaxed)) {
+            shard.max_ns[metric].store(ns, memory_order_relaxed);
+        }
+    }
+
+    // merges every thread's shard for one metric
+    static LatencyHistogram snapshot(Metric metric) {
+        LatencyHistogram result;
+        Metrics& m = instance();
+        lock_guard<mutex> guard(m.shards_lock);
+        for (const auto& shard : m.shards) {
+            LatencyHistogram part;
+            for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; i++) {
+                part.counts[i] = shard->counts[metric][i].load(memory_order_relaxed);
+                part.count += part.counts[i];
+            }
+            part.total_ns = shard->total_ns[metric].load(memory_order_relaxed);
+            part.max_ns = shard->max_ns[metric].load(memory_order_relaxed);
+            result.merge(part);
+        }
+        return result;
+    }
+
+    static void dump(ostream& out) {
+        out << left << setw(22) << "operation" << right << setw(10) << "count" << setw(12) << "mean(us)"
+            << setw(12) << "p50(us)" << setw(12) << "p99(us)" << setw(12) << "p999(us)" << setw(12) << "max(us)" << "\n";
+        for (int m = 0; m < NUM_METRICS; m++) {
+            LatencyHistogram h = snapshot(static_cast<Metric>(m));
+            if (h.count == 0) {
+                continue;
+            }
+            out << left << setw(22) << metric_names[m] << right << setw(10) << h.count << fixed << setprecision(1)
+                << setw(12) << h.total_ns / 1000.0 / h.count
+                << setw(12) << h.percentile(0.50) / 1000.0 << setw(12) << h.percentile(0.99) / 1000.0
+                << setw(12) << h.percentile(0.999) / 1000.0 << setw(12) << h.max_ns / 1000.0 << "\n";
+        }
+    }
+
+    static void dump_to_file(const string& filename) {
+        ofstream file(filename);
+        if (file.is_open()) {
+            dump(file);
+        }
+    }
+};
+
+// times the enclosing scope into the given metric
+class ScopedTimer {
+    Metric metric;
+    chrono::steady_clock::time_point begin;
+public:
+    explicit ScopedTimer(Metric m) : metric(m), begin(chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        Metrics::record(metric, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count());
+    }
+};
+
+#define METRICS_CONCAT_(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_(a, b)
+
+#ifdef EVENT_METRICS
+#define METRICS_SCOPE(metric) ScopedTimer METRICS_CONCAT(metrics_timer_, __LINE__)(metric)
+#define METRICS_DUMP(filename) Metrics::dump_to_file(filename)
+#else
+#define METRICS_SCOPE(metric) do {} while (0)
+#define METRICS_DUMP(filename) do {} while (0)
+#endif
+
+// writes stats.txt when destroyed; System declares one first so it is destroyed
+// last, after the save in ~System and everything else it measures
+struct MetricsDumpOnExit {
+    ~MetricsDumpOnExit() {
+        METRICS_DUMP("stats.txt");
+    }
+};
+
+#endif // METRICS_HPP
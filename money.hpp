@@ -0,0 +1,31 @@
+#ifndef MONEY_HPP
+#define MONEY_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+
+using namespace std;
+
+// Stored prices are whole cents, so a price written to a file and read back
+// is the price that was written. Arithmetic on balances stays in dollars.
+typedef int32_t Cents;
+
+// the largest price a Cents holds, about $21.4 million
+const double MAX_PRICE = INT32_MAX / 100.0;
+
+// throws out_of_range rather than wrap a price a Cents cannot hold
+inline Cents to_cents(double dollars) {
+    double cents = round(dollars * 100);
+    if (!(cents >= INT32_MIN && cents <= INT32_MAX)) { // NaN fails too
+        throw out_of_range("price out of range: " + to_string(dollars));
+    }
+    return (Cents)cents;
+}
+
+inline double to_dollars(Cents cents) {
+    return cents / 100.0;
+}
+
+#endif // MONEY_HPP
@@ -0,0 +1,232 @@
+#ifndef NAME_INDEX_HPP
+#define NAME_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include "name_table.hpp"
+
+using namespace std;
+
+// a name found for what was typed; distance is how many edits the typed text is
+// from the closest start of the name, so a name it begins exactly is at 0
+struct NameMatch {
+    string name;
+    int distance;
+};
+
+// Names in a trie, ignoring case, for finding one from the start of it or from a
+// near miss. match() ranks names by distance, then in name order, so the exact
+// name comes first, then names it begins, then names a typo or two away. The edit
+// distance is worked out row by row down the trie and a branch is dropped once
+// every entry passes the bound, so a lookup only visits branches near the text,
+// however many names there are. Removed names leave their nodes behind, empty,
+// for the next name that needs them.
+class NameIndex {
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        uint32_t child = NONE;   // first child; children are in character order
+        uint32_t sibling = NONE;
+        uint32_t live = 0;       // names ending at or below this node
+        char c = 0;
+    };
+
+    vector<Node> nodes;                             // nodes[0] is the root
+    unordered_map<uint32_t, vector<uint32_t>> ends; // node -> ids of the names ending there
+
+    static char fold(char c) {
+        return (char)tolower((unsigned char)c);
+    }
+
+    // edits allowed for text of this length; short text has to be typed right
+    static int bound(size_t length) {
+        return length < 4 ? 0 : length < 8 ? 1 : 2;
+    }
+
+    uint32_t find_child(uint32_t node, char c) const {
+        for (uint32_t child = nodes[node].child; child != NONE && nodes[child].c <= c; child = nodes[child].sibling) {
+            if (nodes[child].c == c) {
+                return child;
+            }
+        }
+        return NONE;
+    }
+
+    uint32_t add_child(uint32_t node, char c) {
+        uint32_t* link = &nodes[node].child;
+        while (*link != NONE && nodes[*link].c < c) {
+            link = &nodes[*link].sibling;
+        }
+        if (*link != NONE && nodes[*link].c == c) {
+            return *link;
+        }
+        uint32_t child = nodes.size();
+        Node added;
+        added.c = c;
+        added.sibling = *link;
+        *link = child; // before the push_back, which may move the nodes
+        nodes.push_back(added);
+        return child;
+    }
+
+    // Nodes where the text, all of it, is within the bound of the path to the node and
+    // closer than at any node above; names at or below such a node start near the text.
+    void find_anchors(const string& text, int max_edits, uint32_t node, size_t depth, int best,
+                      vector<vector<int>>& rows, vector<pair<int, uint32_t>>& anchors) const {
+        if (rows.size() <= depth + 1) {
+            rows.emplace_back(text.size() + 1);
+        }
+        for (uint32_t child = nodes[node].child; child != NONE; child = nodes[child].sibling) {
+            if (nodes[child].live == 0) {
+                continue;
+            }
+            const vector<int>& above = rows[depth];
+            vector<int>& row = rows[depth + 1];
+            row[0] = above[0] + 1;
+            int lowest = row[0];
+            for (size_t j = 1; j <= text.size(); j++) {
+                row[j] = min({above[j] + 1, row[j - 1] + 1, above[j - 1] + (text[j - 1] != nodes[child].c)});
+                lowest = min(lowest, row[j]);
+            }
+            if (lowest > max_edits) {
+                continue; // nothing below can come back within the bound
+            }
+            int here = row[text.size()];
+            if (here <= max_edits && here < best) {
+                anchors.emplace_back(here, child);
+            }
+            find_anchors(text, max_edits, child, depth + 1, min(best, here), rows, anchors);
+        }
+    }
+
+    // the names at and below node in name order, until found has limit of them
+    void collect(uint32_t node, int distance, size_t limit, const function<bool(const string&)>& allowed,
+                 const unordered_set<uint32_t>& listed, vector<NameMatch>& found) const {
+        if (listed.count(node)) {
+            return; // a closer anchor already had these
+        }
+        auto at = ends.find(node);
+        if (at != ends.end()) {
+            vector<string> names;
+            for (uint32_t id : at->second) {
+                names.push_back(NameTable::name(id));
+            }
+            sort(names.begin(), names.end());
+            names.erase(unique(names.begin(), names.end()), names.end());
+            for (const string& name : names) {
+                if (found.size() < limit && (!allowed || allowed(name))) {
+                    found.push_back({name, distance});
+                }
+            }
+        }
+        for (uint32_t child = nodes[node].child; child != NONE && found.size() < limit; child = nodes[child].sibling) {
+            if (nodes[child].live > 0) {
+                collect(child, distance, limit, allowed, listed, found);
+            }
+        }
+    }
+
+public:
+    NameIndex() : nodes(1) {}
+
+    void insert(const string& name) {
+        uint32_t node = 0;
+        nodes[0].live++;
+        for (char c : name) {
+            node = add_child(node, fold(c));
+            nodes[node].live++;
+        }
+        ends[node].push_back(NameTable::intern(name));
+    }
+
+    // removes one copy of name, if there is one
+    void erase(const string& name) {
+        vector<uint32_t> path{0};
+        for (char c : name) {
+            uint32_t child = find_child(path.back(), fold(c));
+            if (child == NONE) {
+                return;
+            }
+            path.push_back(child);
+        }
+        auto at = ends.find(path.back());
+        if (at == ends.end()) {
+            return;
+        }
+        auto id = find(at->second.begin(), at->second.end(), NameTable::intern(name));
+        if (id == at->second.end()) {
+            return;
+        }
+        at->second.erase(id);
+        if (at->second.empty()) {
+            ends.erase(at);
+        }
+        for (uint32_t node : path) {
+            nodes[node].live--;
+        }
+    }
+
+    // whether name itself is in the index, exactly as written
+    bool contains(const string& name) const {
+        uint32_t node = 0;
+        for (char c : name) {
+            node = find_child(node, fold(c));
+            if (node == NONE) {
+                return false;
+            }
+        }
+        auto at = ends.find(node);
+        return at != ends.end() && any_of(at->second.begin(), at->second.end(),
+            [&](uint32_t id) { return NameTable::name(id) == name; });
+    }
+
+    void clear() {
+        nodes.assign(1, Node());
+        ends.clear();
+    }
+
+    size_t size() const {
+        return nodes[0].live;
+    }
+
+    // Up to limit names for text, best first, of those allowed says yes to (all of them
+    // if it is empty). A name that is there more than once is listed once.
+    vector<NameMatch> match(const string& typed, size_t limit, const function<bool(const string&)>& allowed = nullptr) const {
+        string text;
+        for (char c : typed) {
+            text += fold(c);
+        }
+        int max_edits = bound(text.size());
+        vector<vector<int>> rows(1, vector<int>(text.size() + 1));
+        for (size_t j = 0; j <= text.size(); j++) {
+            rows[0][j] = j;
+        }
+        vector<pair<int, uint32_t>> anchors; // distance, node
+        if ((int)text.size() <= max_edits) {
+            anchors.emplace_back(text.size(), 0);
+        }
+        find_anchors(text, max_edits, 0, 0, text.size(), rows, anchors);
+
+        // closest first; anchors at the same distance are apart and in name order
+        stable_sort(anchors.begin(), anchors.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+        unordered_set<uint32_t> listed; // anchors whose names are all in found
+        vector<NameMatch> found;
+        for (const auto& [distance, anchor] : anchors) {
+            if (found.size() >= limit) {
+                break;
+            }
+            collect(anchor, distance, limit, allowed, listed, found);
+            listed.insert(anchor);
+        }
+        return found;
+    }
+};
+
+#endif // NAME_INDEX_HPP
@@ -0,0 +1,43 @@
+#ifndef NAME_TABLE_HPP
+#define NAME_TABLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+
+using namespace std;
+
+// Event and user names as 32 bit ids, so a record holds an id where it would
+// hold a string. Ids are never reused and the strings never move, so what
+// name() returns stays valid for the life of the process. Not thread safe,
+// it is used under the same lock as the System.
+class NameTable {
+    deque<string> names;                        // by id
+    unordered_map<string_view, uint32_t> ids;   // views into names
+
+    static NameTable& instance() {
+        static NameTable table;
+        return table;
+    }
+
+public:
+    static uint32_t intern(string_view name) {
+        NameTable& table = instance();
+        auto it = table.ids.find(name);
+        if (it != table.ids.end()) {
+            return it->second;
+        }
+        uint32_t id = table.names.size();
+        table.names.emplace_back(name);
+        table.ids.emplace(table.names.back(), id);
+        return id;
+    }
+
+    static const string& name(uint32_t id) {
+        return instance().names[id];
+    }
+};
+
+#endif // NAME_TABLE_HPP
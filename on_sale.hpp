@@ -0,0 +1,133 @@
+#ifndef ON_SALE_HPP
+#define ON_SALE_HPP
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "user.hpp"
+
+using namespace std;
+
+enum SaleOutcome {
+    SALE_BOUGHT,
+    SALE_WAITLISTED,
+    SALE_FAILED // could not pay, or the event is gone
+};
+
+// Tickets left, split over cache-line sized shards so buyers on different
+// threads take from different counters instead of fighting over one. A buyer
+// starts at its own shard and only moves on to the others when it runs dry.
+// Only an admission check: the seats themselves are assigned when the queue
+// is settled, which is also where an over-admitted request gets turned away.
+class ShardedCounter {
+public:
+    static const int SHARDS = 16;
+
+private:
+    struct alignas(64) Shard {
+        atomic<int> left{0};
+    };
+    Shard shards[SHARDS];
+
+public:
+    void reset(int total) {
+        for (int s = 0; s < SHARDS; s++) {
+            shards[s].left.store(total / SHARDS + (s < total % SHARDS), memory_order_relaxed);
+        }
+    }
+
+    // takes n units, from several shards if need be; all or nothing
+    bool take(int n, size_t hint) {
+        int taken = 0;
+        for (int i = 0; i < SHARDS && taken < n; i++) {
+            atomic<int>& left = shards[(hint + i) % SHARDS].left;
+            int have = left.load(memory_order_relaxed);
+            while (have > 0 && !left.compare_exchange_weak(have, have - min(have, n - taken), memory_order_relaxed)) {
+            }
+            taken += max(0, min(have, n - taken));
+        }
+        if (taken < n) {
+            give_back(taken, hint);
+            return false;
+        }
+        return true;
+    }
+
+    void give_back(int n, size_t hint) {
+        if (n > 0) {
+            shards[hint % SHARDS].left.fetch_add(n, memory_order_relaxed);
+        }
+    }
+};
+
+// On-sale mode for one hot event. Buyers submit purchase requests from any
+// thread without holding the System; each is admitted or not against the
+// sharded counter and queued in arrival order. Whoever holds the System then
+// settles the whole queue in one round, see Facility::settle_sale: seats are
+// assigned, admitted buyers that got none and the ones turned away at the
+// door join the waitlist in the order they arrived, and the organizer is paid
+// once per round. Buyers wait on the future they were handed.
+class OnSale {
+public:
+    struct Request {
+        User* user;
+        int count;
+        bool admitted;
+        size_t shard;
+        promise<SaleOutcome> outcome;
+    };
+
+private:
+    string event_name;
+    ShardedCounter inventory;
+    mutex queue_lock; // held only to append to or swap out the queue
+    vector<Request> queue;
+
+public:
+    OnSale(string event_name, int tickets_left) : event_name(move(event_name)) {
+        inventory.reset(tickets_left);
+    }
+
+    OnSale(const OnSale&) = delete;
+    OnSale& operator=(const OnSale&) = delete;
+
+    const string& get_event_name() const {
+        return event_name;
+    }
+
+    // safe from any thread
+    future<SaleOutcome> submit(User* user, int count) {
+        size_t shard = hash<thread::id>()(this_thread::get_id());
+        Request request{user, count, count > 0 && inventory.take(count, shard), shard, promise<SaleOutcome>()};
+        future<SaleOutcome> outcome = request.outcome.get_future();
+        lock_guard<mutex> guard(queue_lock);
+        queue.push_back(move(request));
+        return outcome;
+    }
+
+    // the requests queued so far, oldest first
+    vector<Request> take_batch() {
+        vector<Request> batch;
+        lock_guard<mutex> guard(queue_lock);
+        batch.swap(queue);
+        return batch;
+    }
+
+    // an admitted request that did not end up with seats
+    void give_back(const Request& request) {
+        if (request.admitted) {
+            inventory.give_back(request.count, request.shard);
+        }
+    }
+
+    // seats came back some other way, e.g. a cancelled ticket nobody on the waitlist
+    // took; added to what is left, as buyers may be taking from it at the same time
+    void restock(int added) {
+        inventory.give_back(added, 0);
+    }
+};
+
+#endif // ON_SALE_HPP
@@ -0,0 +1,90 @@
+#ifndef PRICING_HPP
+#define PRICING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "user.hpp"
+
+using namespace std;
+
+// Every price the facility charges comes from here: the hourly rate by user
+// type, the service charge added when a reservation is paid for, the
+// cancellation penalty and which meeting styles each user type may book.
+// The rule table is constexpr so lookups compile down to constant loads.
+
+struct PricingRules {
+    static constexpr int NUM_USER_TYPES = 3;
+    static constexpr int NUM_STYLES = 4; // Meeting, Lecture, Wedding, DanceRoom
+
+    // indexed by USER_TYPE: city, resident, non-resident
+    static constexpr double hourly_rate[NUM_USER_TYPES] = {5, 10, 15};
+    // [USER_TYPE][MeetingStyle]: the city cannot book weddings
+    static constexpr bool style_allowed[NUM_USER_TYPES][NUM_STYLES] = {
+        {true, true, false, true},
+        {true, true, true, true},
+        {true, true, true, true},
+    };
+
+    static constexpr double service_charge = 10;
+    static constexpr double cancellation_fee = 10;
+    static constexpr double late_cancellation_rate = 0.01; // of the reservation cost
+    static constexpr int late_cancellation_days = 7;
+    // a booking can be displaced by the city only while more than this many whole days out
+    static constexpr int override_lock_days = 7;
+
+    // the room is open 9 AM to 9 PM
+    static constexpr int opening_hour = 9;
+    static constexpr int closing_hour = 21;
+};
+
+class Pricing {
+public:
+    static constexpr double hourly_rate(USER_TYPE type) {
+        return PricingRules::hourly_rate[type];
+    }
+
+    static constexpr bool style_allowed(USER_TYPE type, int style) {
+        return PricingRules::style_allowed[type][style];
+    }
+
+    // true for events booked at the city rate, which longer-notice bookings may override
+    static constexpr bool is_city_rate(double price_per_hour) {
+        return price_per_hour == PricingRules::hourly_rate[CITY];
+    }
+
+    static constexpr bool within_opening_hours(int start_hour, int end_hour) {
+        return start_hour >= PricingRules::opening_hour && end_hour < PricingRules::closing_hour;
+    }
+
+    // rent for the room, charged for whole hours
+    static constexpr double reservation_cost(double price_per_hour, long long whole_hours) {
+        return price_per_hour * whole_hours;
+    }
+
+    // what the organizer pays to confirm a reservation
+    static constexpr double amount_due(double reservation_cost) {
+        return reservation_cost + PricingRules::service_charge;
+    }
+
+    // kept by the facility when an organizer cancels; late (within late_cancellation_days of the start) adds the late fee
+    static constexpr double cancellation_penalty(double amount_due, bool late) {
+        return PricingRules::cancellation_fee + (late ? PricingRules::late_cancellation_rate * amount_due : 0);
+    }
+
+    // Quotes n candidate bookings in one pass, e.g. a whole price calendar.
+    // Inputs are parallel arrays; out[i] is the amount due for candidate i,
+    // or -1 if that user type cannot book that style or the slot is outside
+    // opening hours. The loop is branch free so the compiler can vectorize it.
+    static void quote_batch(const int32_t* start_hour, const int32_t* duration_hours, const uint8_t* user_type,
+                            const uint8_t* style, size_t n, double* out) {
+        for (size_t i = 0; i < n; i++) {
+            int end_hour = start_hour[i] + duration_hours[i];
+            bool bookable = PricingRules::style_allowed[user_type[i]][style[i]]
+                & (start_hour[i] >= PricingRules::opening_hour) & (end_hour < PricingRules::closing_hour);
+            double due = PricingRules::hourly_rate[user_type[i]] * duration_hours[i] + PricingRules::service_charge;
+            out[i] = bookable ? due : -1;
+        }
+    }
+};
+
+#endif // PRICING_HPP
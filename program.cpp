@@ -3,13 +3,33 @@
 #include <sstream>
 #include <chrono>
 #include <iomanip>
+#include <limits>
 #include "system.hpp"
 #include "user.hpp"
+#include "server.hpp"
+#include "client.hpp"
 
 using namespace std;
 using namespace std::chrono;
 
-int main() {
+int main(int argc, char* argv[]) {
+    // ./program --serve [socket] keeps the system resident for many clients,
+    // ./program --connect [socket] is a thin client for such a server
+    if (argc > 1) {
+        string mode = argv[1];
+        string socket_path = argc > 2 ? argv[2] : DEFAULT_SOCKET_PATH;
+        if (mode == "--serve") {
+            System system;
+            Server server(system, socket_path);
+            return server.run() ? 0 : 1;
+        }
+        if (mode == "--connect") {
+            return run_thin_client(socket_path);
+        }
+        cerr << "usage: " << argv[0] << " [--serve [socket] | --connect [socket]]\n";
+        return 1;
+    }
+
     System system;
     string username;
     int type;
@@ -28,9 +48,13 @@ int main() {
         cin >> balance;
 
         cout << "Please enter whatever best describes you: 1, 2, or 3\n1) Worker for the city\n2) Resident of Newton\n3) Non-Resident of Newton\n(Default: non-resident)\n";
-        cin >> type;
+        if (!(cin >> type)) {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            type = NON_RESIDENT + 1;
+        }
 
-        USER_TYPE userType = static_cast<USER_TYPE>(type - 1);
+        USER_TYPE userType = to_user_type(type - 1);
         system.create_user(username, balance, userType);
         currentUser = system.login_user(username);
     }
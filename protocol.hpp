@@ -0,0 +1,73 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Request/response framing between the thin client and the server.
+//
+// A request is one line: the command and its arguments separated by tabs,
+// e.g. "BUY\tHenry's Birthday Party\n". Arguments may contain spaces but not
+// tabs or newlines.
+// A response is a header line "OK\t<length>\n" or "ERR\t<length>\n" followed
+// by <length> bytes of text for the client to print.
+
+static const char* const DEFAULT_SOCKET_PATH = "eventsystem.sock";
+static const size_t MAX_REQUEST_LINE = 64 * 1024;
+
+inline string encode_request(const vector<string>& fields) {
+    string line;
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) {
+            line += '\t';
+        }
+        for (char c : fields[i]) {
+            line += (c == '\t' || c == '\n') ? ' ' : c;
+        }
+    }
+    line += '\n';
+    return line;
+}
+
+// splits a request line (without its newline) into fields
+inline vector<string> decode_request(const string& line) {
+    vector<string> fields;
+    size_t begin = 0;
+    while (true) {
+        size_t tab = line.find('\t', begin);
+        if (tab == string::npos) {
+            fields.push_back(line.substr(begin));
+            break;
+        }
+        fields.push_back(line.substr(begin, tab - begin));
+        begin = tab + 1;
+    }
+    return fields;
+}
+
+inline string encode_response(bool ok, const string& body) {
+    return string(ok ? "OK" : "ERR") + "\t" + to_string(body.size()) + "\n" + body;
+}
+
+// parses a response header line; returns false if it is malformed
+inline bool decode_response_header(const string& line, bool& ok, size_t& length) {
+    size_t tab = line.find('\t');
+    if (tab == string::npos) {
+        return false;
+    }
+    string status = line.substr(0, tab);
+    if (status != "OK" && status != "ERR") {
+        return false;
+    }
+    ok = status == "OK";
+    try {
+        length = stoul(line.substr(tab + 1));
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+#endif // PROTOCOL_HPP
@@ -0,0 +1,116 @@
+#ifndef RCU_HPP
+#define RCU_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+// One published version of a T that readers use without locks while a writer
+// replaces it. A reader pins the version current when it started and keeps it
+// until it lets go; publish() swaps in the next version and never waits for
+// readers. A version that was replaced is freed once no reader can still hold
+// it: readers count themselves in one of two phases, and a retired version is
+// freed after the phase it was retired in has flipped out and drained twice.
+// Readers spread their counts over cache-line sized shards by thread.
+template <typename T>
+class Rcu {
+    static const int SHARDS = 16;
+
+    struct alignas(64) Counter {
+        atomic<long> readers{0};
+    };
+
+    mutable Counter counters[2][SHARDS]; // readers in each phase
+    atomic<int> phase{0};
+    atomic<const T*> current{nullptr};
+    mutex writer;                // publishers take turns
+    vector<const T*> retiring;   // replaced during this phase
+    vector<const T*> retired;    // replaced during the last one, readers may still hold them
+
+    static int shard() {
+        static thread_local int index = hash<thread::id>()(this_thread::get_id()) % SHARDS;
+        return index;
+    }
+
+    bool drained(int p) const {
+        for (const Counter& counter : counters[p]) {
+            if (counter.readers.load() != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // with writer held: once nobody reads in the other phase, whatever was retired
+    // before the last flip is unreachable, so free it and flip again
+    void reclaim() {
+        int p = phase.load();
+        if (!drained(1 - p)) {
+            return; // try again at the next publish
+        }
+        for (const T* old : retired) {
+            delete old;
+        }
+        retired.swap(retiring);
+        retiring.clear();
+        phase.store(1 - p);
+    }
+
+public:
+    Rcu() = default;
+    Rcu(const Rcu&) = delete;
+    Rcu& operator=(const Rcu&) = delete;
+
+    // no reader may be left when this runs
+    ~Rcu() {
+        delete current.load();
+        for (const T* old : retiring) {
+            delete old;
+        }
+        for (const T* old : retired) {
+            delete old;
+        }
+    }
+
+    // Pins the current version for as long as it lives; nullptr before the first publish.
+    class Reader {
+        const Rcu& rcu;
+        int p;
+        int index;
+        const T* version;
+
+    public:
+        explicit Reader(const Rcu& rcu) : rcu(rcu), p(rcu.phase.load()), index(shard()) {
+            rcu.counters[p][index].readers.fetch_add(1);
+            version = rcu.current.load();
+        }
+
+        ~Reader() {
+            rcu.counters[p][index].readers.fetch_sub(1);
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const T* get() const { return version; }
+        const T& operator*() const { return *version; }
+        const T* operator->() const { return version; }
+    };
+
+    // makes next the version new readers see; the one it replaces is freed later
+    void publish(unique_ptr<const T> next) {
+        lock_guard<mutex> guard(writer);
+        const T* old = current.exchange(next.release());
+        if (old) {
+            retiring.push_back(old);
+        }
+        reclaim();
+    }
+};
+
+#endif // RCU_HPP
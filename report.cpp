@@ -0,0 +1,115 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+#include "report.hpp"
+
+using namespace std;
+
+// Operator reports over live and archived events and the penalty ledger.
+//
+// usage: ./report <data_dir> [--by day|organizer] [--format csv|json] [--threads N]
+//        ./report <data_dir> --archive-before MM-DD-YYYY
+//
+// --archive-before moves events that ended before the date from
+// events_data.csv to events_archive.csv, where reports still see them.
+
+static void usage(const char* program) {
+    cerr << "usage: " << program << " <data_dir> [--by day|organizer] [--format csv|json] [--threads N]\n"
+         << "       " << program << " <data_dir> --archive-before MM-DD-YYYY\n";
+}
+
+// moves past events into the archive; runs under the exclusive state lock like a save
+static int archive_before(const string& date) {
+    int year, month, day;
+    if (!Calendar::parse_mdy(date, year, month, day)) {
+        cerr << "bad date " << date << ", expected MM-DD-YYYY\n";
+        return 1;
+    }
+    long long cutoff = Calendar::to_utc(year, month, day);
+
+    FileLock lock(STATE_LOCK_FILE, true);
+    string live;
+    read_file("events_data.csv", live);
+    string kept, archived;
+    int count = 0;
+    for (string_view line : split_lines(live)) {
+        if (line.empty()) {
+            continue;
+        }
+        EventRecord record(line);
+        string& out = record.end() < cutoff ? archived : kept;
+        out += line;
+        out += '\n';
+        if (record.end() < cutoff) {
+            remove(("waitlist/waitlist_" + record.name() + ".csv").c_str());
+            count++;
+        }
+    }
+    // archive first: if we stop in between, an event is in both files rather than neither
+    if (!append_to_file(EVENT_ARCHIVE_FILE, archived) || !write_file_atomically("events_data.csv", kept)) {
+        cerr << "archiving failed\n";
+        return 1;
+    }
+    cerr << "archived " << count << " events\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    string by = "day", format = "csv", archive_date;
+    int threads = max(1u, thread::hardware_concurrency());
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--by") {
+            by = argv[++i];
+        } else if (arg == "--format") {
+            format = argv[++i];
+        } else if (arg == "--threads") {
+            threads = stoi(argv[++i]);
+        } else if (arg == "--archive-before") {
+            archive_date = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((by != "day" && by != "organizer") || (format != "csv" && format != "json")) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (chdir(argv[1]) != 0) {
+        cerr << "cannot enter " << argv[1] << "\n";
+        return 1;
+    }
+    if (!archive_date.empty()) {
+        return archive_before(archive_date);
+    }
+
+    string live, archive, ledger;
+    {
+        FileLock lock(STATE_LOCK_FILE, false);
+        read_file("events_data.csv", live);
+        read_file(EVENT_ARCHIVE_FILE, archive);
+        read_file(PENALTY_LEDGER_FILE, ledger);
+    }
+    vector<string_view> event_lines = split_lines(archive);
+    vector<string_view> live_lines = split_lines(live);
+    event_lines.insert(event_lines.end(), live_lines.begin(), live_lines.end());
+
+    Report report = Report::build(Report::latest_versions(event_lines), split_lines(ledger), threads);
+    if (by == "day") {
+        report.write_days(cout, format == "json");
+    } else {
+        report.write_organizers(cout, format == "json");
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <charconv>
+#include <iostream>
+#include "store.hpp"
+#include "ticket.hpp"
+#include "pricing.hpp"
+#include "calendar.hpp"
+
+using namespace std;
+
+// Operator reports built in one pass over events_data.csv lines (live and
+// archived) and the penalty ledger. The lines are split into one partition
+// per thread, each thread aggregates its partition into its own Report, and
+// the partial reports are merged at the end.
+
+struct DayStats {
+    int events = 0;            // confirmed events starting that day
+    double booked_hours = 0;
+    double penalty_income = 0; // cancellation fees charged that day
+};
+
+struct OrganizerStats {
+    int events = 0;
+    int confirmed = 0;
+    double facility_revenue = 0; // what confirmed reservations paid the facility
+    int tickets_sold = 0;
+    int ticket_capacity = 0;
+    double ticket_revenue = 0;   // what sold tickets paid the organizer
+    int cancellations = 0;
+    double penalties = 0;
+};
+
+class Report {
+public:
+    map<long long, DayStats> days; // keyed by local date as YYYYMMDD
+    map<string, OrganizerStats, less<>> organizers;
+
+    // local calendar date of an epoch time as YYYYMMDD
+    static long long day_of(long long epoch_seconds) {
+        return Calendar::local(epoch_seconds).ymd();
+    }
+
+    // one events_data.csv line:
+    // name,creator,start,end,price,public,open,style,confirmed,cost[,ticket_price,holder,purchased]*
+    void add_event(string_view line) {
+        string_view fields[EventRecord::TICKETS_BEGIN];
+        for (int i = 0; i < EventRecord::TICKETS_BEGIN; i++) {
+            size_t comma = min(line.find(','), line.size());
+            fields[i] = line.substr(0, comma);
+            line.remove_prefix(comma);
+            if (i + 1 < EventRecord::TICKETS_BEGIN && !line.empty()) {
+                line.remove_prefix(1);
+            }
+        }
+        long long start = to_number<long long>(fields[2]);
+        long long end = to_number<long long>(fields[3]);
+        bool confirmed = fields[8] == "1";
+
+        OrganizerStats& organizer = organizer_stats(fields[1]);
+        organizer.events++;
+        if (confirmed) {
+            double price_per_hour = to_number<double>(fields[4]);
+            organizer.confirmed++;
+            organizer.facility_revenue += Pricing::amount_due(Pricing::reservation_cost(price_per_hour, (end - start) / 3600));
+            DayStats& day = days[day_of(start)];
+            day.events++;
+            day.booked_hours += (end - start) / 3600.0;
+        }
+        for_each_ticket_field(line, [&](string_view price, string_view owner, string_view purchased) {
+            organizer.ticket_capacity++;
+            if (!owner.empty() && purchased == "1") {
+                organizer.tickets_sold++;
+                organizer.ticket_revenue += to_number<double>(price);
+            }
+        });
+    }
+
+    // one penalty ledger line: event,organizer,cancelled_at,penalty
+    void add_penalty(string_view line) {
+        string_view event_name = first_field(line);
+        line.remove_prefix(min(line.size(), event_name.size() + 1));
+        string_view organizer_name = first_field(line);
+        line.remove_prefix(min(line.size(), organizer_name.size() + 1));
+        string_view cancelled_at = first_field(line);
+        line.remove_prefix(min(line.size(), cancelled_at.size() + 1));
+        double amount = to_number<double>(line);
+
+        OrganizerStats& organizer = organizer_stats(organizer_name);
+        organizer.cancellations++;
+        organizer.penalties += amount;
+        days[day_of(to_number<long long>(cancelled_at))].penalty_income += amount;
+    }
+
+    void merge(const Report& other) {
+        for (const auto& pair : other.days) {
+            DayStats& day = days[pair.first];
+            day.events += pair.second.events;
+            day.booked_hours += pair.second.booked_hours;
+            day.penalty_income += pair.second.penalty_income;
+        }
+        for (const auto& pair : other.organizers) {
+            OrganizerStats& organizer = organizer_stats(pair.first);
+            organizer.events += pair.second.events;
+            organizer.confirmed += pair.second.confirmed;
+            organizer.facility_revenue += pair.second.facility_revenue;
+            organizer.tickets_sold += pair.second.tickets_sold;
+            organizer.ticket_capacity += pair.second.ticket_capacity;
+            organizer.ticket_revenue += pair.second.ticket_revenue;
+            organizer.cancellations += pair.second.cancellations;
+            organizer.penalties += pair.second.penalties;
+        }
+    }
+
+    // An event can be in the archive and the live file both, or in the archive twice:
+    // archiving appends before it rewrites the live file, and both a save and report
+    // --archive-before archive. Keeps the last line for each name and start, so with
+    // the archive read before the live file the newest version counts, once.
+    static vector<string_view> latest_versions(const vector<string_view>& event_lines) {
+        unordered_set<string_view> seen;
+        vector<string_view> latest;
+        for (size_t i = event_lines.size(); i-- > 0; ) {
+            string_view line = event_lines[i];
+            size_t key_end = 0; // name,creator,start
+            for (int field = 0; field < 3 && key_end != string_view::npos; field++) {
+                key_end = line.find(',', key_end + (field > 0));
+            }
+            if (!line.empty() && seen.insert(line.substr(0, key_end)).second) {
+                latest.push_back(line);
+            }
+        }
+        reverse(latest.begin(), latest.end());
+        return latest;
+    }
+
+    // Aggregates event and penalty lines with the given number of threads.
+    // The lines are views into buffers the caller keeps alive.
+    static Report build(const vector<string_view>& event_lines, const vector<string_view>& penalty_lines, int threads) {
+        threads = max(1, threads);
+        vector<Report> partials(threads);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (size_t i = t * event_lines.size() / threads; i < (t + 1) * event_lines.size() / threads; i++) {
+                    if (!event_lines[i].empty()) {
+                        partials[t].add_event(event_lines[i]);
+                    }
+                }
+                for (size_t i = t * penalty_lines.size() / threads; i < (t + 1) * penalty_lines.size() / threads; i++) {
+                    if (!penalty_lines[i].empty()) {
+                        partials[t].add_penalty(penalty_lines[i]);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (int t = 1; t < threads; t++) {
+            partials[0].merge(partials[t]);
+        }
+        return move(partials[0]);
+    }
+
+    // One row per day, opening hours are the room's capacity. Written row by row.
+    void write_days(ostream& out, bool json) const {
+        const double open_hours = PricingRules::closing_hour - PricingRules::opening_hour;
+        out << (json ? "[" : "date,events,booked_hours,utilization,penalty_income\n");
+        bool first = true;
+        for (const auto& pair : days) {
+            char date[32]; // room for any year a corrupt start time gives, not just four digits
+            snprintf(date, sizeof(date), "%04lld-%02lld-%02lld", pair.first / 10000, pair.first / 100 % 100, pair.first % 100);
+            const DayStats& day = pair.second;
+            if (json) {
+                out << (first ? "\n" : ",\n") << "{\"date\":\"" << date << "\",\"events\":" << day.events
+                    << ",\"booked_hours\":" << day.booked_hours << ",\"utilization\":" << day.booked_hours / open_hours
+                    << ",\"penalty_income\":" << day.penalty_income << "}";
+            } else {
+                out << date << ',' << day.events << ',' << day.booked_hours << ',' << day.booked_hours / open_hours
+                    << ',' << day.penalty_income << '\n';
+            }
+            first = false;
+        }
+        out << (json ? "\n]\n" : "");
+    }
+
+    // one row per organizer
+    void write_organizers(ostream& out, bool json) const {
+        out << (json ? "[" : "organizer,events,confirmed,facility_revenue,tickets_sold,ticket_capacity,sell_through,ticket_revenue,cancellations,penalties\n");
+        bool first = true;
+        for (const auto& pair : organizers) {
+            const OrganizerStats& o = pair.second;
+            double sell_through = o.ticket_capacity ? (double)o.tickets_sold / o.ticket_capacity : 0;
+            if (json) {
+                out << (first ? "\n" : ",\n") << "{\"organizer\":\"" << json_escaped(pair.first) << "\",\"events\":" << o.events
+                    << ",\"confirmed\":" << o.confirmed << ",\"facility_revenue\":" << o.facility_revenue
+                    << ",\"tickets_sold\":" << o.tickets_sold << ",\"ticket_capacity\":" << o.ticket_capacity
+                    << ",\"sell_through\":" << sell_through << ",\"ticket_revenue\":" << o.ticket_revenue
+                    << ",\"cancellations\":" << o.cancellations << ",\"penalties\":" << o.penalties << "}";
+            } else {
+                out << pair.first << ',' << o.events << ',' << o.confirmed << ',' << o.facility_revenue << ','
+                    << o.tickets_sold << ',' << o.ticket_capacity << ',' << sell_through << ',' << o.ticket_revenue << ','
+                    << o.cancellations << ',' << o.penalties << '\n';
+            }
+            first = false;
+        }
+        out << (json ? "\n]\n" : "");
+    }
+
+private:
+    OrganizerStats& organizer_stats(string_view name) {
+        auto it = organizers.find(name);
+        if (it == organizers.end()) {
+            it = organizers.emplace(string(name), OrganizerStats()).first;
+        }
+        return it->second;
+    }
+
+    template <typename T>
+    static T to_number(string_view field) {
+        T value = 0;
+        from_chars(field.data(), field.data() + field.size(), value);
+        return value;
+    }
+
+    static string json_escaped(const string& s) {
+        string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out;
+    }
+};
+
+#endif // REPORT_HPP
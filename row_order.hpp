@@ -0,0 +1,65 @@
+#ifndef ROW_ORDER_HPP
+#define ROW_ORDER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Stable ids for the rows of a vector that only grows at the back, so an index
+// can hold a row's id and leave it alone while rows in front of it are erased.
+// Ids are handed out in row order; a row's position is the number of live ids
+// below its own, counted in a Fenwick tree, so finding it and erasing a row
+// both cost O(log n) instead of renumbering every later row.
+class RowOrder {
+    vector<uint32_t> tree; // Fenwick tree over ids, 1-based: live ids in each range
+    size_t live = 0;
+
+    // live ids below id
+    size_t below(uint32_t id) const {
+        size_t count = 0;
+        for (size_t i = id; i > 0; i &= i - 1) {
+            count += tree[i];
+        }
+        return count;
+    }
+
+public:
+    // the id of a row added at the back
+    uint32_t append() {
+        if (tree.empty()) {
+            tree.push_back(0); // index 0 is unused
+        }
+        uint32_t id = tree.size() - 1;
+        size_t i = id + 1;
+        // a new node covers (i - lowbit(i), i]: this id and the live ids before it in that range
+        tree.push_back(1 + below(i - 1) - below(i - (i & -i)));
+        live++;
+        return id;
+    }
+
+    // the row with this id was erased
+    void erase(uint32_t id) {
+        for (size_t i = id + 1; i < tree.size(); i += i & -i) {
+            tree[i]--;
+        }
+        live--;
+    }
+
+    // where the live row with this id is now
+    size_t position(uint32_t id) const {
+        return below(id);
+    }
+
+    size_t size() const {
+        return live;
+    }
+
+    void clear() {
+        tree.clear();
+        live = 0;
+    }
+};
+
+#endif // ROW_ORDER_HPP
@@ -0,0 +1,403 @@
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include "event.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// how a paged listing is sorted; ties go to the other field
+enum ListingOrder { BY_START, BY_NAME };
+
+// an event as the schedule listings show it
+struct ScheduleRow {
+    string name;
+    string organizer;
+    time_point<system_clock> start;
+    time_point<system_clock> end;
+    double cost_to_attend;
+    MeetingStyle style;
+    bool is_public;
+    bool open_to_non;
+    bool confirmed;
+
+    int64_t start_seconds() const {
+        return duration_cast<seconds>(start.time_since_epoch()).count();
+    }
+};
+
+// A vector that published versions share. Elements sit in fixed-size chunks
+// behind shared_ptr, so copying it copies one pointer a chunk, and a write
+// copies only the chunk it lands in, unless no other version holds that chunk.
+template <typename T>
+class SharedChunks {
+    static const size_t CHUNK = 256;
+
+    vector<shared_ptr<vector<T>>> chunks;
+    size_t count = 0;
+
+    // a chunk this copy may change: its own, or a copy of a shared one
+    vector<T>& writable(size_t chunk) {
+        if (chunks[chunk].use_count() > 1) {
+            chunks[chunk] = make_shared<vector<T>>(*chunks[chunk]);
+        }
+        return *chunks[chunk];
+    }
+
+public:
+    size_t size() const {
+        return count;
+    }
+
+    const T& operator[](size_t i) const {
+        return (*chunks[i / CHUNK])[i % CHUNK];
+    }
+
+    // grows to fit i, with default values in between
+    void set(size_t i, T value) {
+        while (count <= i) {
+            if (count % CHUNK == 0) {
+                chunks.push_back(make_shared<vector<T>>());
+                chunks.back()->reserve(CHUNK);
+            }
+            writable(chunks.size() - 1).emplace_back();
+            count++;
+        }
+        writable(i / CHUNK)[i % CHUNK] = move(value);
+    }
+};
+
+// A sorted list that published versions share, chunked the same way: a version
+// copies the chunk pointers, and an insert or erase copies the one chunk it
+// touches. A chunk that outgrows CHUNK splits in two and an empty one goes, so
+// finding a value is a binary search over the chunks and then within one.
+template <typename T>
+class SharedSortedList {
+    static const size_t CHUNK = 512;
+
+    vector<shared_ptr<vector<T>>> chunks; // none of them empty
+    size_t count = 0;
+
+    vector<T>& writable(size_t chunk) {
+        if (chunks[chunk].use_count() > 1) {
+            chunks[chunk] = make_shared<vector<T>>(*chunks[chunk]);
+        }
+        return *chunks[chunk];
+    }
+
+public:
+    class const_iterator {
+        friend class SharedSortedList;
+        const SharedSortedList* list;
+        size_t chunk;
+        size_t index;
+
+        const_iterator(const SharedSortedList* list, size_t chunk, size_t index) : list(list), chunk(chunk), index(index) {}
+
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const T& operator*() const {
+            return (*list->chunks[chunk])[index];
+        }
+
+        const_iterator& operator++() {
+            if (++index == list->chunks[chunk]->size()) {
+                chunk++;
+                index = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return chunk == other.chunk && index == other.index;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    const_iterator begin() const {
+        return const_iterator(this, 0, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, chunks.size(), 0);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // the first value pred says no to; pred says yes to all of the values before it
+    template <typename Pred>
+    const_iterator partition_point(Pred pred) const {
+        size_t chunk = std::partition_point(chunks.begin(), chunks.end(),
+            [&](const shared_ptr<vector<T>>& values) { return pred(values->back()); }) - chunks.begin();
+        if (chunk == chunks.size()) {
+            return end();
+        }
+        const vector<T>& values = *chunks[chunk];
+        return const_iterator(this, chunk, std::partition_point(values.begin(), values.end(), pred) - values.begin());
+    }
+
+    // the value at it, by one that sorts the same
+    void replace(const_iterator it, T value) {
+        writable(it.chunk)[it.index] = move(value);
+    }
+
+    template <typename Less>
+    void insert(T value, Less less) {
+        if (chunks.empty()) {
+            chunks.push_back(make_shared<vector<T>>(1, move(value)));
+            count++;
+            return;
+        }
+        const_iterator at = partition_point([&](const T& other) { return less(other, value); });
+        size_t chunk = at == end() ? chunks.size() - 1 : at.chunk;
+        vector<T>& values = writable(chunk);
+        values.insert(at == end() ? values.end() : values.begin() + at.index, move(value));
+        count++;
+        if (values.size() > CHUNK) {
+            auto upper = make_shared<vector<T>>(values.begin() + CHUNK / 2, values.end());
+            values.erase(values.begin() + CHUNK / 2, values.end());
+            chunks.insert(chunks.begin() + chunk + 1, move(upper));
+        }
+    }
+
+    void erase(const_iterator it) {
+        vector<T>& values = writable(it.chunk);
+        values.erase(values.begin() + it.index);
+        if (values.empty()) {
+            chunks.erase(chunks.begin() + it.chunk);
+        }
+        count--;
+    }
+
+    // removes the value that sorts the same as value, if there is one
+    template <typename Less>
+    void erase(const T& value, Less less) {
+        const_iterator at = partition_point([&](const T& other) { return less(other, value); });
+        if (at != end() && !less(value, *at)) {
+            erase(at);
+        }
+    }
+};
+
+// A copy of the schedule that never changes once published, so the listings
+// can read it without the System's lock; see Facility::publish_schedule. A
+// version is the one before with the rows that changed swapped in and moved
+// within the listings; everything else is shared with it. Each listing is kept
+// sorted both ways, so a page is a binary search for where the last one
+// stopped and then page size rows.
+struct Schedule {
+    // the rows of one listing
+    struct Listing {
+        string organizer; // whose events, for the listings in by_organizer
+        SharedSortedList<uint32_t> in_order; // in the order of the facility's events, which is row id order
+        SharedSortedList<uint32_t> by_start;
+        SharedSortedList<uint32_t> by_name;
+
+        const SharedSortedList<uint32_t>& sorted(ListingOrder order) const {
+            return order == BY_NAME ? by_name : by_start;
+        }
+    };
+
+    // a row id and what is there now, nullptr once the event is gone
+    typedef vector<pair<uint32_t, shared_ptr<const ScheduleRow>>> Changes;
+
+    uint64_t version = 0;
+    SharedChunks<shared_ptr<const ScheduleRow>> rows; // by the row ids of EventColumns
+    Listing confirmed;        // the schedule
+    Listing open;             // what residents can buy tickets for
+    Listing open_to_non;      // what non-residents can
+    SharedSortedList<shared_ptr<const Listing>> by_organizer; // by organizer, none of them empty
+
+    Schedule() = default;
+
+    // the version after previous, with changes applied to its rows and listings
+    Schedule(const Schedule& previous, uint64_t version, const Changes& changes)
+        : version(version), rows(previous.rows), confirmed(previous.confirmed), open(previous.open),
+          open_to_non(previous.open_to_non), by_organizer(previous.by_organizer) {
+        for (const auto& change : changes) {
+            uint32_t id = change.first;
+            if (id < rows.size() && rows[id]) {
+                place(id, false);
+            }
+            rows.set(id, change.second);
+            if (change.second) {
+                place(id, true);
+            }
+        }
+    }
+
+    // the row of a live event
+    const ScheduleRow& row(uint32_t id) const {
+        return *rows[id];
+    }
+
+    // the organizer's listing, or an empty one
+    const Listing& organized_by(const string& organizer) const {
+        static const Listing none;
+        auto it = find_organizer(organizer);
+        return it == by_organizer.end() || (*it)->organizer != organizer ? none : **it;
+    }
+
+    // Up to page_size rows of listing in order, starting after the row cursor names ("" to
+    // start at the top). In start order the page can also be kept to starts from from to
+    // to. Sets next to the cursor for the page after, "" if this one is the last.
+    vector<uint32_t> page(const Listing& listing, ListingOrder order, size_t page_size, const string& cursor,
+                          string& next, int64_t from = INT64_MIN, int64_t to = INT64_MAX) const {
+        const SharedSortedList<uint32_t>& sorted = listing.sorted(order);
+        string last = cursor.empty() ? "" : decode_cursor(cursor, order);
+        Key after{cursor.empty() ? 0 : stoll(last.substr(0, last.find(':'))), string_view(last).substr(last.find(':') + 1)};
+        // rows up to the cursor and, in start order, rows before from are both a prefix
+        auto it = sorted.partition_point([&](uint32_t id) {
+            return (!cursor.empty() && !less(order, after, key_of(row(id))))
+                || (order == BY_START && row(id).start_seconds() < from);
+        });
+        vector<uint32_t> result;
+        for (; it != sorted.end() && result.size() < page_size; ++it) {
+            if (order == BY_START && row(*it).start_seconds() > to) {
+                break;
+            }
+            result.push_back(*it);
+        }
+        next.clear();
+        bool more = it != sorted.end() && (order != BY_START || row(*it).start_seconds() <= to);
+        if (more && !result.empty()) {
+            const ScheduleRow& last = row(result.back());
+            next = encode_cursor(order, to_string(last.start_seconds()) + ":" + last.name);
+        }
+        return result;
+    }
+
+private:
+    struct Key {
+        int64_t start;
+        string_view name;
+    };
+
+    static Key key_of(const ScheduleRow& row) {
+        return {row.start_seconds(), row.name};
+    }
+
+    static bool less(ListingOrder order, const Key& a, const Key& b) {
+        if (order == BY_NAME) {
+            return a.name != b.name ? a.name < b.name : a.start < b.start;
+        }
+        return a.start != b.start ? a.start < b.start : a.name < b.name;
+    }
+
+    // by key in order, then by row id, like a stable sort of the rows in row id order
+    bool before(ListingOrder order, uint32_t a, uint32_t b) const {
+        Key first = key_of(row(a));
+        Key second = key_of(row(b));
+        if (less(order, first, second) || less(order, second, first)) {
+            return less(order, first, second);
+        }
+        return a < b;
+    }
+
+    // adds row id to the listings it is in, or takes it out of them
+    void place(uint32_t id, bool add) {
+        const ScheduleRow& event = row(id);
+        if (event.confirmed) {
+            place(confirmed, id, add);
+            if (event.is_public) {
+                place(open, id, add);
+                if (event.open_to_non) {
+                    place(open_to_non, id, add);
+                }
+            }
+        }
+        // the organizer's listing is shared too: copy it, change the copy, put that in its place
+        auto it = find_organizer(event.organizer);
+        bool found = it != by_organizer.end() && (*it)->organizer == event.organizer;
+        auto listing = found ? make_shared<Listing>(**it) : make_shared<Listing>();
+        listing->organizer = event.organizer;
+        place(*listing, id, add);
+        if (!found) {
+            by_organizer.insert(move(listing), [](const shared_ptr<const Listing>& a, const shared_ptr<const Listing>& b) {
+                return a->organizer < b->organizer;
+            });
+        } else if (listing->in_order.empty()) {
+            by_organizer.erase(it);
+        } else {
+            by_organizer.replace(it, move(listing));
+        }
+    }
+
+    void place(Listing& listing, uint32_t id, bool add) {
+        auto by_id = [](uint32_t a, uint32_t b) { return a < b; };
+        auto by_start = [this](uint32_t a, uint32_t b) { return before(BY_START, a, b); };
+        auto by_name = [this](uint32_t a, uint32_t b) { return before(BY_NAME, a, b); };
+        if (add) {
+            listing.in_order.insert(id, by_id);
+            listing.by_start.insert(id, by_start);
+            listing.by_name.insert(id, by_name);
+        } else {
+            listing.in_order.erase(id, by_id);
+            listing.by_start.erase(id, by_start);
+            listing.by_name.erase(id, by_name);
+        }
+    }
+
+    // where organizer's listing is, or would go
+    SharedSortedList<shared_ptr<const Listing>>::const_iterator find_organizer(const string& organizer) const {
+        return by_organizer.partition_point([&](const shared_ptr<const Listing>& listing) { return listing->organizer < organizer; });
+    }
+
+    // A cursor is the sort key of the last row shown, in hex so it is one plain token
+    // whatever the name holds. Keys stay meaningful across versions: a page picks up
+    // after that key even if rows came and went since.
+    static string encode_cursor(ListingOrder order, const string& key) {
+        static const char digits[] = "0123456789abcdef";
+        string cursor(1, order == BY_NAME ? 'n' : 's');
+        for (unsigned char c : key) {
+            cursor += digits[c >> 4];
+            cursor += digits[c & 15];
+        }
+        return cursor;
+    }
+
+    static string decode_cursor(const string& cursor, ListingOrder order) {
+        if (cursor[0] != (order == BY_NAME ? 'n' : 's') || cursor.size() % 2 == 0) {
+            throw invalid_argument("cursor is not from this listing");
+        }
+        string key;
+        for (size_t i = 1; i < cursor.size(); i += 2) {
+            string byte = cursor.substr(i, 2);
+            if (byte.find_first_not_of("0123456789abcdef") != string::npos) {
+                throw invalid_argument("bad cursor");
+            }
+            key += (char)stoi(byte, nullptr, 16);
+        }
+        size_t colon = key.find(':');
+        if (colon == string::npos || colon == 0 || key.find_first_not_of("-0123456789") < colon) {
+            throw invalid_argument("bad cursor");
+        }
+        return key;
+    }
+};
+
+#endif // SCHEDULE_HPP
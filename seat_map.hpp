@@ -0,0 +1,165 @@
+#ifndef SEAT_MAP_HPP
+#define SEAT_MAP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// a block of the room laid out the same way, e.g. the center of a lecture
+struct SeatSection {
+    string name;
+    int rows;
+    int seats_per_row; // at most 64, a row is one bitmap word
+};
+
+// The seats of a room setup. Seats are numbered row by row, best row first:
+// row 1 of every section in the order they are listed, then row 2, and so on.
+// A ticket's position in events_data.csv is its seat number, so a layout must
+// only ever grow at the end.
+class SeatLayout {
+public:
+    struct Row {
+        int section;
+        int number; // 1 is the front
+        int first;  // seat number of its first seat
+        int seats;
+    };
+
+private:
+    vector<SeatSection> sections;
+    vector<Row> rows;
+    int capacity = 0;
+
+    SeatLayout(vector<SeatSection> sections) : sections(move(sections)) {
+        int most_rows = 0;
+        for (const SeatSection& section : this->sections) {
+            most_rows = max(most_rows, section.rows);
+        }
+        for (int r = 0; r < most_rows; r++) {
+            for (int s = 0; s < (int)this->sections.size(); s++) {
+                if (r < this->sections[s].rows) {
+                    rows.push_back({s, r + 1, capacity, this->sections[s].seats_per_row});
+                    capacity += this->sections[s].seats_per_row;
+                }
+            }
+        }
+    }
+
+public:
+    // by MeetingStyle; a Meeting keeps the 25 seats every event used to have
+    static const SeatLayout& of(int style) {
+        static const SeatLayout layouts[] = {
+            SeatLayout({{"Table", 5, 5}}),                                    // Meeting
+            SeatLayout({{"Center", 8, 12}, {"Left", 8, 6}, {"Right", 8, 6}}), // Lecture
+            SeatLayout({{"Left", 8, 6}, {"Right", 8, 6}}),                    // Wedding
+            SeatLayout({{"Floor", 3, 20}}),                                   // DanceRoom
+        };
+        return layouts[style >= 0 && style < 4 ? style : 0];
+    }
+
+    int get_capacity() const {
+        return capacity;
+    }
+
+    const vector<Row>& get_rows() const {
+        return rows;
+    }
+
+    // the row a seat is in
+    const Row& row_of(int seat) const {
+        return *(upper_bound(rows.begin(), rows.end(), seat, [](int s, const Row& row) { return s < row.first; }) - 1);
+    }
+
+    // e.g. "Center row 2 seat 7"
+    string label(int seat) const {
+        const Row& row = row_of(seat);
+        return sections[row.section].name + " row " + to_string(row.number) + " seat " + to_string(seat - row.first + 1);
+    }
+};
+
+// Which seats of a layout are free, one bitmap word per row. Finding a block
+// of k adjacent free seats in a row takes O(log k) word operations, so group
+// bookings cost about the same as single seats whatever the room size.
+class SeatMap {
+    const SeatLayout* layout = nullptr;
+    vector<uint64_t> free_bits; // bit i of word r: seat i of row r is free
+    vector<uint8_t> free_in_row;
+    int free_seats = 0;
+
+    // bits that start a run of k set bits in x
+    static uint64_t run_starts(uint64_t x, int k) {
+        for (int have = 1; have < k; ) {
+            int step = min(have, k - have);
+            x &= x >> step;
+            have += step;
+        }
+        return x;
+    }
+
+public:
+    SeatMap() = default;
+
+    explicit SeatMap(const SeatLayout& layout) : layout(&layout) {
+        for (const SeatLayout::Row& row : layout.get_rows()) {
+            free_bits.push_back(row.seats == 64 ? ~uint64_t(0) : (uint64_t(1) << row.seats) - 1);
+            free_in_row.push_back(row.seats);
+        }
+        free_seats = layout.get_capacity();
+    }
+
+    int free_count() const {
+        return free_seats;
+    }
+
+    bool is_free(int seat) const {
+        const SeatLayout::Row& row = layout->row_of(seat);
+        size_t r = &row - layout->get_rows().data();
+        return (free_bits[r] >> (seat - row.first)) & 1;
+    }
+
+    void take(int seat) {
+        const SeatLayout::Row& row = layout->row_of(seat);
+        size_t r = &row - layout->get_rows().data();
+        uint64_t bit = uint64_t(1) << (seat - row.first);
+        if (free_bits[r] & bit) {
+            free_bits[r] &= ~bit;
+            free_in_row[r]--;
+            free_seats--;
+        }
+    }
+
+    void release(int seat) {
+        const SeatLayout::Row& row = layout->row_of(seat);
+        size_t r = &row - layout->get_rows().data();
+        uint64_t bit = uint64_t(1) << (seat - row.first);
+        if (!(free_bits[r] & bit)) {
+            free_bits[r] |= bit;
+            free_in_row[r]++;
+            free_seats++;
+        }
+    }
+
+    // First seat of the best block of count adjacent free seats: the lowest
+    // seats in the best row that has one. -1 if no row has one.
+    int best_block(int count) const {
+        if (count < 1 || count > free_seats) {
+            return -1;
+        }
+        const vector<SeatLayout::Row>& rows = layout->get_rows();
+        for (size_t r = 0; r < rows.size(); r++) {
+            if (free_in_row[r] < count) {
+                continue;
+            }
+            uint64_t starts = run_starts(free_bits[r], count);
+            if (starts) {
+                return rows[r].first + __builtin_ctzll(starts);
+            }
+        }
+        return -1;
+    }
+};
+
+#endif // SEAT_MAP_HPP
@@ -0,0 +1,393 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "system.hpp"
+#include "protocol.hpp"
+
+using namespace std;
+
+// Daemon mode: keeps one System resident and serves many thin clients over a
+// Unix domain socket. A single epoll loop owns the System, so requests run one
+// at a time and never race each other; state is saved once, when the server stops.
+
+static volatile sig_atomic_t server_stop_requested = 0;
+
+static void request_server_stop(int) {
+    server_stop_requested = 1;
+}
+
+class Server {
+    struct Session {
+        string inbuf;
+        string outbuf;
+        User* user = nullptr; // logged in user, points into System::users
+    };
+
+    System& system;
+    string socket_path;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    map<int, Session> sessions;
+
+public:
+    Server(System& system, const string& socket_path) : system(system), socket_path(socket_path) {}
+
+    ~Server() {
+        for (auto& pair : sessions) {
+            close(pair.first);
+        }
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(socket_path.c_str());
+        }
+    }
+
+    // serves clients until SIGINT or SIGTERM; returns false if the socket could not be set up
+    bool run() {
+        if (!listen_on_socket()) {
+            return false;
+        }
+        struct sigaction action = {};
+        action.sa_handler = request_server_stop;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        cerr << "Serving on " << socket_path << "\n";
+        epoll_event ready[64];
+        while (!server_stop_requested) {
+            int n = epoll_wait(epoll_fd, ready, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                cerr << "epoll_wait failed: " << strerror(errno) << "\n";
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = ready[i].data.fd;
+                if (fd == listen_fd) {
+                    accept_clients();
+                    continue;
+                }
+                if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close_session(fd);
+                    continue;
+                }
+                if ((ready[i].events & EPOLLIN) && !read_requests(fd)) {
+                    continue;
+                }
+                if (ready[i].events & EPOLLOUT) {
+                    flush(fd);
+                }
+            }
+        }
+        cerr << "Shutting down, saving state.\n";
+        return true;
+    }
+
+private:
+    static void set_nonblocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    bool listen_on_socket() {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            cerr << "Socket path too long: " << socket_path << "\n";
+            return false;
+        }
+        strcpy(addr.sun_path, socket_path.c_str());
+        unlink(socket_path.c_str()); // left behind by a server that did not shut down cleanly
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+            cerr << "Failed to listen on " << socket_path << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        set_nonblocking(listen_fd);
+
+        epoll_fd = epoll_create1(0);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+        return true;
+    }
+
+    void accept_clients() {
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return; // EAGAIN once the backlog is drained
+            }
+            set_nonblocking(fd);
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+            sessions[fd];
+        }
+    }
+
+    void close_session(int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        sessions.erase(fd);
+    }
+
+    // reads what is available and answers every complete request; false if the session closed
+    bool read_requests(int fd) {
+        Session& session = sessions[fd];
+        char buf[4096];
+        while (true) {
+            ssize_t got = read(fd, buf, sizeof(buf));
+            if (got > 0) {
+                session.inbuf.append(buf, got);
+                continue;
+            }
+            if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                close_session(fd);
+                return false;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        size_t begin = 0, newline;
+        while ((newline = session.inbuf.find('\n', begin)) != string::npos) {
+            string line = session.inbuf.substr(begin, newline - begin);
+            begin = newline + 1;
+            bool ok;
+            string body = handle(session, decode_request(line), ok);
+            session.outbuf += encode_response(ok, body);
+        }
+        session.inbuf.erase(0, begin);
+        if (session.inbuf.size() > MAX_REQUEST_LINE) {
+            close_session(fd);
+            return false;
+        }
+        return flush(fd);
+    }
+
+    // writes as much pending output as the socket takes; false if the session closed
+    bool flush(int fd) {
+        Session& session = sessions[fd];
+        while (!session.outbuf.empty()) {
+            ssize_t sent = write(fd, session.outbuf.data(), session.outbuf.size());
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                close_session(fd);
+                return false;
+            }
+            session.outbuf.erase(0, sent);
+        }
+        // only ask for EPOLLOUT while there is something left to write
+        epoll_event ev = {};
+        ev.events = session.outbuf.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT);
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        return true;
+    }
+
+    // runs one request; whatever System prints becomes the response body
+    string handle(Session& session, const vector<string>& fields, bool& ok) {
+        ostringstream out;
+        streambuf* console = cout.rdbuf(out.rdbuf());
+        try {
+            ok = dispatch(session, fields);
+        } catch (const exception& e) {
+            out << "Bad request: " << e.what() << "\n";
+            ok = false;
+        }
+        cout.rdbuf(console);
+        return out.str();
+    }
+
+    static ListingOrder listing_order(const string& field) {
+        if (field != "start" && field != "name") {
+            throw invalid_argument("sort by start or name");
+        }
+        return field == "name" ? BY_NAME : BY_START;
+    }
+
+    static size_t page_size(const string& field) {
+        int size = stoi(field);
+        if (size < 1) {
+            throw invalid_argument("page size must be at least 1");
+        }
+        return size;
+    }
+
+    // the last line of a page, if there is a page after it
+    static void print_next_page(const string& cursor) {
+        if (!cursor.empty()) {
+            cout << "Next page: " << cursor << "\n";
+        }
+    }
+
+    bool dispatch(Session& session, const vector<string>& fields) {
+        const string& command = fields[0];
+        size_t argc = fields.size() - 1;
+
+        if (command == "LOGIN" && argc == 1) {
+            session.user = system.login_user(fields[1]);
+            if (!session.user) {
+                cout << "No existing user found.\n";
+                return false;
+            }
+            return true;
+        }
+        if (command == "CREATE" && argc == 3) {
+            system.create_user(fields[1], stod(fields[2]), to_user_type(stoi(fields[3])));
+            session.user = system.login_user(fields[1]);
+            return session.user != nullptr;
+        }
+        if (command == "STATS" && argc == 0) {
+            // for operators, no login needed: what the server holds and how long the requests took
+            cout << "sessions: " << sessions.size() << "\nusers: " << system.get_users().size()
+                << "\nevents: " << system.get_facility().get_events().size() << "\n";
+#ifdef EVENT_METRICS
+            Metrics::dump(cout);
+#else
+            cout << "Latency metrics are off, build with make METRICS=1.\n";
+#endif
+            return true;
+        }
+        if (!session.user) {
+            cout << "Please log in first.\n";
+            return false;
+        }
+
+        User* user = session.user;
+        if (command == "WHOAMI" && argc == 0) {
+            cout << user->get_user_name() << "\n";
+            return true;
+        }
+        if (command == "SCHEDULE" && argc == 1) {
+            system.get_facility().print_schedule(stoi(fields[1]));
+            return true;
+        }
+        if (command == "SCHEDULEPAGE" && (argc == 2 || argc == 3)) {
+            // days, page size, the cursor the last page ended with
+            print_next_page(system.get_facility().print_schedule_page(stoi(fields[1]), page_size(fields[2]), argc == 3 ? fields[3] : ""));
+            return true;
+        }
+        if (command == "PRICES" && argc == 2) {
+            // length in hours, style 1-4
+            int duration = stoi(fields[1]);
+            if (duration < 1 || duration > 24) {
+                cout << "Length must be 1 to 24 hours.\n";
+                return false;
+            }
+            system.print_price_calendar(user, duration, System::meeting_style_from_choice(stoi(fields[2])));
+            return true;
+        }
+        if (command == "RESERVE" && argc == 8) {
+            // name, MM-DD-YYYY, start hour, duration, public, open to non-residents, style 1-4, ticket cost
+            time_point<system_clock> start_time = System::reservation_start(fields[2], stoi(fields[3]));
+            MeetingStyle style = System::meeting_style_from_choice(stoi(fields[7]));
+            bool reserved = system.reserve_event(user, fields[1], start_time, stoi(fields[4]), fields[5] == "1", fields[6] == "1", style, stod(fields[8]));
+            cout << (reserved ? "Reservation created successfully.\n" : "Failed to create reservation.\n");
+            return reserved;
+        }
+        if (command == "MYEVENTS" && argc == 0) {
+            system.display_events_by_organizer(user->get_user_name());
+            return true;
+        }
+        if (command == "MYEVENTSPAGE" && (argc == 2 || argc == 3)) {
+            // start or name, page size, cursor
+            print_next_page(system.display_events_by_organizer_page(user->get_user_name(), listing_order(fields[1]),
+                page_size(fields[2]), argc == 3 ? fields[3] : ""));
+            return true;
+        }
+        if (command == "COST" && argc == 1) {
+            double total_cost = system.get_event_cost(fields[1]);
+            if (total_cost == -1) {
+                cout << "Event not found or already confirmed.\n";
+                return false;
+            }
+            cout << total_cost << "\n" << user->get_bank_balance() << "\n";
+            return true;
+        }
+        if (command == "PAY" && argc == 1) {
+            bool paid = system.pay_for_event(user, fields[1]);
+            cout << (paid ? "Payment successful and event confirmed.\n" : "Payment failed.\n");
+            return paid;
+        }
+        if (command == "AVAILABLE" && argc == 0) {
+            system.browse_events(user);
+            return true;
+        }
+        if (command == "AVAILABLEPAGE" && (argc == 2 || argc == 3)) {
+            // start or name, page size, cursor
+            print_next_page(system.browse_events_page(user, listing_order(fields[1]), page_size(fields[2]), argc == 3 ? fields[3] : ""));
+            return true;
+        }
+        if (command == "BUY" && (argc == 1 || argc == 2)) {
+            bool bought = system.buy_ticket(user, fields[1], argc == 2 ? stoi(fields[2]) : 1);
+            cout << (bought ? "Ticket purchase successful!\n" : "Was not able to purchase ticket\n");
+            return bought;
+        }
+        if (command == "CANCELTICKET" && argc == 1) {
+            if (!system.cancel_ticket(user, fields[1])) {
+                cout << "It does not look like you have a ticket to this event\n";
+                return false;
+            }
+            return true;
+        }
+        if (command == "CANCELEVENT" && argc == 1) {
+            bool cancelled = system.cancel_event(user, fields[1]);
+            cout << (cancelled ? "Cancellation successful\n" : "Cancellation unsuccessful\n");
+            return cancelled;
+        }
+        if ((command == "OPENSALE" || command == "CLOSESALE") && argc == 1) {
+            // the organizer takes a hot event in and out of on-sale mode
+            const Event* event = system.get_facility().find_event(fields[1]);
+            if (!event || event->get_creator_username() != user->get_user_name()) {
+                cout << "You do not host an event with that name.\n";
+                return false;
+            }
+            if (command == "CLOSESALE") {
+                system.close_sale(fields[1]);
+                cout << "The sale is closed.\n";
+                return true;
+            }
+            bool opened = system.open_sale(fields[1]);
+            cout << (opened ? "The event is on sale.\n" : "Only a public event open to non-residents can go on sale.\n");
+            return opened;
+        }
+        if (command == "TICKETS" && argc == 0) {
+            system.print_tickets(user);
+            return true;
+        }
+        cout << "Unknown request: " << command << "\n";
+        return false;
+    }
+};
+
+#endif // SERVER_HPP
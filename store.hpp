@@ -0,0 +1,354 @@
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <charconv>
+#include <string_view>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "pricing.hpp"
+
+using namespace std;
+
+// Helpers that let several program processes share the data files.
+//
+// Each process loads under a shared lock and saves under an exclusive one, so
+// nobody reads a half written file. Saves are optimistic merges: a process
+// only writes back the records it changed, and only wins outright if the
+// record on disk still matches what it loaded. When somebody else changed the
+// same event in the meantime the two versions are merged ticket by ticket.
+// Balances and the budget are merged as deltas, so they never conflict.
+
+static const char* const STATE_LOCK_FILE = ".state.lock";
+static const char* const PENALTY_LEDGER_FILE = "penalties.csv"; // event,organizer,cancelled_at,penalty
+static const char* const EVENT_ARCHIVE_FILE = "events_archive.csv"; // events_data.csv lines of past events
+
+// flock() on the lock file for as long as the object lives
+class FileLock {
+    int fd;
+public:
+    FileLock(const string& path, bool exclusive) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd >= 0) {
+            flock(fd, exclusive ? LOCK_EX : LOCK_SH);
+        }
+    }
+
+    ~FileLock() {
+        if (fd >= 0) {
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+};
+
+// While one of these lives, write_file_atomically and append_to_file hold their
+// writes back until commit(), so a save that fails part way leaves every file as
+// it was rather than some written and some not. The temp files are written as
+// they come; commit only renames them and appends, the steps that cannot run out
+// of space. Used by the checkpoint child, whose parent has to know what is on disk.
+class StagedWrites {
+    vector<pair<string, string>> renames; // temp file, file
+    vector<pair<string, string>> appends; // file, lines
+    bool failed = false;
+    bool committed = false;
+
+    static StagedWrites*& active() {
+        static StagedWrites* staged = nullptr;
+        return staged;
+    }
+
+public:
+    StagedWrites() {
+        active() = this;
+    }
+
+    ~StagedWrites() {
+        active() = nullptr;
+        if (!committed) {
+            for (const auto& pair : renames) {
+                remove(pair.first.c_str());
+            }
+        }
+    }
+
+    StagedWrites(const StagedWrites&) = delete;
+    StagedWrites& operator=(const StagedWrites&) = delete;
+
+    static StagedWrites* current() {
+        return active();
+    }
+
+    void rename_later(const string& tmp, const string& path) {
+        renames.emplace_back(tmp, path);
+    }
+
+    void append_later(const string& path, const string& content) {
+        appends.emplace_back(path, content);
+    }
+
+    void write_failed() {
+        failed = true;
+    }
+
+    // Makes the writes show, in the order they were made. False, and nothing shown,
+    // if one of them failed; false too if a rename or append fails part way.
+    bool commit();
+};
+
+// readers never see a partial file: write a temp file next to it and rename
+inline bool write_file_atomically(const string& path, const string& content) {
+    string tmp = path + ".tmp";
+    StagedWrites* staged = StagedWrites::current();
+    {
+        ofstream file(tmp, ios::trunc);
+        file << content;
+        if (!file.is_open() || !file) {
+            if (staged) {
+                staged->write_failed();
+            }
+            return false;
+        }
+    }
+    if (staged) {
+        staged->rename_later(tmp, path);
+        return true;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// for append-only logs: whole lines land at the end even with several writers
+inline bool append_to_file(const string& path, const string& content) {
+    if (StagedWrites* staged = StagedWrites::current()) {
+        staged->append_later(path, content);
+        return true;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, content.data(), content.size()) == (ssize_t)content.size();
+    close(fd);
+    return ok;
+}
+
+inline bool StagedWrites::commit() {
+    if (failed) {
+        return false;
+    }
+    active() = nullptr; // from here on the writes are for real
+    committed = true;
+    bool ok = true;
+    for (const auto& pair : appends) {
+        ok &= append_to_file(pair.first, pair.second);
+    }
+    for (const auto& pair : renames) {
+        ok &= rename(pair.first.c_str(), pair.second.c_str()) == 0;
+    }
+    return ok;
+}
+
+inline bool read_file(const string& path, string& content) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    stringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+inline vector<string> read_lines(const string& path) {
+    vector<string> lines;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// number formatting for the save path, appends in place instead of going through a stream
+inline void append_number(string& out, long long value) {
+    char buf[24];
+    auto result = to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr);
+}
+
+inline void append_number(string& out, double value) {
+    char buf[32];
+    auto result = to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr);
+}
+
+// views of each line in a file's content, which must outlive them
+inline vector<string_view> split_lines(string_view content) {
+    vector<string_view> lines;
+    lines.reserve(count(content.begin(), content.end(), '\n') + 1);
+    size_t begin = 0;
+    while (begin < content.size()) {
+        size_t end = content.find('\n', begin);
+        if (end == string_view::npos) {
+            end = content.size();
+        }
+        lines.push_back(content.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return lines;
+}
+
+// first comma separated field of a line
+inline string_view first_field(string_view line) {
+    return line.substr(0, line.find(','));
+}
+
+// sorted first-field -> line number lookup over a file's lines
+class LineIndex {
+    vector<pair<string_view, size_t>> entries;
+
+public:
+    static const size_t npos = (size_t)-1;
+
+    explicit LineIndex(const vector<string_view>& lines) {
+        entries.reserve(lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            entries.emplace_back(first_field(lines[i]), i);
+        }
+        sort(entries.begin(), entries.end());
+    }
+
+    size_t find(string_view key) const {
+        auto it = lower_bound(entries.begin(), entries.end(), make_pair(key, (size_t)0));
+        return it != entries.end() && it->first == key ? it->second : npos;
+    }
+};
+
+// multiset difference a - b on unsorted name lists, keeping a's order
+inline vector<string> subtract_names(const vector<string>& a, const vector<string>& b) {
+    map<string, int> remove;
+    for (const string& name : b) {
+        remove[name]++;
+    }
+    vector<string> result;
+    for (const string& name : a) {
+        auto it = remove.find(name);
+        if (it != remove.end() && it->second > 0) {
+            it->second--;
+        } else {
+            result.push_back(name);
+        }
+    }
+    return result;
+}
+
+// three way merge of name lists: theirs plus what we added minus what we removed
+inline vector<string> merge_names(const vector<string>& base, const vector<string>& ours, const vector<string>& theirs) {
+    vector<string> merged = subtract_names(theirs, subtract_names(base, ours));
+    vector<string> added = subtract_names(ours, base);
+    merged.insert(merged.end(), added.begin(), added.end());
+    return merged;
+}
+
+// one line of events_data.csv split into its fields:
+// name,creator,start,end,price,public,open,style,confirmed,cost[,ticket_price,holder,purchased]*
+class EventRecord {
+    vector<string> fields;
+
+public:
+    static const int TICKETS_BEGIN = 10;
+
+    explicit EventRecord(string_view line_view) {
+        string line(line_view);
+        stringstream ss(line);
+        string field;
+        while (getline(ss, field, ',')) {
+            fields.push_back(field);
+        }
+        if (!line.empty() && line.back() == ',') {
+            fields.push_back("");
+        }
+        while (fields.size() < TICKETS_BEGIN) {
+            fields.push_back("0");
+        }
+    }
+
+    const string& name() const { return fields[0]; }
+    const string& creator() const { return fields[1]; }
+    long long start() const { return stoll(fields[2]); }
+    long long end() const { return stoll(fields[3]); }
+    bool confirmed() const { return fields[8] == "1"; }
+    double cost_to_attend() const { return stod(fields[9]); }
+    double amount_due() const { return Pricing::amount_due(Pricing::reservation_cost(stod(fields[4]), (end() - start()) / 3600)); }
+
+    void set_confirmed(bool confirmed) {
+        fields[8] = confirmed ? "1" : "0";
+    }
+
+    int capacity() const {
+        return (int)(fields.size() - TICKETS_BEGIN) / 3;
+    }
+
+    // holders of purchased tickets
+    vector<string> holders() const {
+        vector<string> result;
+        for (size_t i = TICKETS_BEGIN; i + 2 < fields.size(); i += 3) {
+            if (!fields[i + 1].empty() && fields[i + 2] == "1") {
+                result.push_back(fields[i + 1]);
+            }
+        }
+        return result;
+    }
+
+    // who holds each seat's ticket, blank if it is not sold; see Event
+    vector<string> seat_holders() const {
+        vector<string> result;
+        for (size_t i = TICKETS_BEGIN; i + 2 < fields.size(); i += 3) {
+            result.push_back(fields[i + 2] == "1" ? fields[i + 1] : string());
+        }
+        return result;
+    }
+
+    // rewrites the tickets from who holds each seat
+    void set_seat_holders(const vector<string>& seats) {
+        string price = fields[9];
+        fields.resize(TICKETS_BEGIN);
+        for (const string& holder : seats) {
+            fields.push_back(price);
+            fields.push_back(holder);
+            fields.push_back(holder.empty() ? "0" : "1");
+        }
+    }
+
+    // the same booking, not another one made under the name after a cancellation
+    bool same_reservation(const EventRecord& other) const {
+        return creator() == other.creator() && start() == other.start() && end() == other.end();
+    }
+
+    bool overlaps(const EventRecord& other) const {
+        return start() < other.end() && end() > other.start();
+    }
+
+    string to_line() const {
+        string line;
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (i > 0) {
+                line += ',';
+            }
+            line += fields[i];
+        }
+        return line;
+    }
+};
+
+#endif // STORE_HPP
@@ -5,51 +5,110 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <memory>
 #include "user.hpp"
 #include "facility.hpp"
+#include "metrics.hpp"
+#include "store.hpp"
+#include "checkpoint.hpp"
+#include "timing_wheel.hpp"
 #include <limits>
+#include <set>
+#include <cerrno>
+#include <dirent.h>
+#include <signal.h>
+#include <stdexcept>
 
 using namespace std;
 
 class System {
-    map<string, User> users;
+    MetricsDumpOnExit metrics_dump;
+    UserRegistry users;
     Facility facility;
 
+    // what this process loaded, so a save can tell its own changes from other processes'
+    map<string, string> loaded_event_lines;
+    map<string, vector<string>> loaded_waitlists;
+    map<string, double> loaded_balances;
+    map<string, double, less<>> merge_refunds;      // owed to users this process never loaded
+    map<string, vector<string>> waitlists_to_write; // filled by save_events
+
+    // tickets held at load for events whose tickets are still unparsed, by holder; see load_holdings
+    map<string, vector<Ticket>> holdings_index;
+    bool holdings_indexed = false;
+
+    // A checkpoint child saves from its copy of memory, so the merge base it ends up with
+    // never reaches this process. It leaves the base in this file instead, for the next
+    // save to pick up. Named after the process that owns the state.
+    Checkpointer checkpointer;
+    string checkpoint_base_file;
+
+    map<string, unique_ptr<OnSale>> sales; // events in on-sale mode, see open_sale
+    bool sales_changed = false;            // opened or closed one since loading on_sale.txt
+
+    // The time rules of an event, in the order they come due. Each event has one
+    // deadline in the wheel at a time; handling it schedules the next.
+    struct Deadline {
+        enum Kind { OVERRIDE_LOCK, LATE_CANCELLATION, START, END };
+        Kind kind;
+        string event_name;
+        int64_t start; // the event's start, so a deadline of a cancelled and rebooked name is ignored
+    };
+    TimingWheel<Deadline> deadlines;
+    set<string, less<>> ended; // confirmed events that are over, archived by the next save
+
 public:
-    System() {
+    System() : checkpoint_base_file(".checkpoint." + to_string(getpid())), deadlines(now_seconds()) {
+        FileLock lock(STATE_LOCK_FILE, false); // other processes may be saving
+        remove_stale_checkpoint_bases();
         load_users_from_file("users.csv");
         load_events("events_data.csv");
-        load_waitlists();
+        facility.set_waitlist_loader([this](Event& event) { load_waitlist(event); });
+        load_sales("on_sale.txt");
+        facility.publish_schedule();
+    }
+
+    // Handles every deadline that has passed since the last call. Entry points that depend
+    // on the time rules call it first; the rules themselves only look at the event's flags.
+    // Flags are not saved: a loaded event's past deadlines all come due on the first call.
+    void tick() {
+        deadlines.advance(now_seconds(), [this](const Deadline& deadline) { handle(deadline); });
+        facility.publish_schedule();
     }
 
     ~System() {
-        save_users_to_file("users.csv");
-        save_events("events_data.csv"); // Save events when the facility is destroyed
-        save_waitlists();
+        save(); // Save events when the facility is destroyed
     }
 
-    // allow the user to login
+    // merges everything this session changed into the data files; safe to call more than once
+    void save() {
+        checkpointer.wait();
+        FileLock lock(STATE_LOCK_FILE, true);
+        adopt_checkpoint_base();
+        save_all();
+        remove(checkpoint_base_file.c_str());
+        facility.publish_schedule();
+    }
+
+    // allow the user to login; nullptr if there is no such user. The pointer stays valid
+    // for the life of the System, and logins may run on other threads than the rest.
     User* login_user(const string& username) {
-        // Check if the user exists in the map
-        auto it = users.find(username);
-        if (it != users.end()) {
-            return &it->second; // Return a pointer to the User
-        }
-        return nullptr; // Return nullptr if user does not exist
+        return users.find(username);
     }
 
-    // create a new user
+    // Creates a new user. Unlike login_user this changes the System, so like the other
+    // entry points that do, it runs under the caller's System lock: the registry is
+    // thread safe, but the merge base and the checkpoint it updates are not.
     void create_user(const string& username, double balance, USER_TYPE userType) {
-        // Check if user already exists
-        if (users.find(username) == users.end()) {
-            // Create and insert new user if not found
-            users.emplace(piecewise_construct,
-                          forward_as_tuple(username),
-                          forward_as_tuple(username, balance, userType));
+        if (users.create(username, balance, userType).second) {
+            loaded_balances[username] = balance;
+            mutated();
         }
     }
 
-    // print the schedule for the user to see, x days in advance
+    // print the schedule for the user to see, x days in advance. Like the other listings
+    // it reads the schedule as last published and does not tick: it may run alongside
+    // anything else, and deadlines show once a call that changes state has run.
     void print_schedule() {
         int days;
         cout << "How many days of the schedule would you like to see (up to 14 days)? ";
@@ -93,7 +152,45 @@ public:
         cin >> cost_to_attend;
         cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Clear any remaining data
 
+        MeetingStyle meeting_style = meeting_style_from_choice(style_choice);
+        system_clock::time_point start_time = reservation_start(date_str, start_hour);
+
+        if (reserve_event(currentUser, event_name, start_time, duration, pubpriv, open_to_non, meeting_style, cost_to_attend)) {
+            cout << "Reservation created successfully.\n";
+        } else {
+            cout << "Failed to create reservation.\n";
+        }
+    }
+
+    // A price calendar: what a booking of duration hours in style would cost user at each
+    // start hour of the day, quoted in one batch. Start hours the room is closed for, or
+    // any start if the user may not book the style, are left out.
+    void print_price_calendar(const User* user, int duration, MeetingStyle style) const {
+        static const int HOURS = 24;
+        int32_t start_hour[HOURS], duration_hours[HOURS];
+        uint8_t user_type[HOURS], styles[HOURS];
+        double due[HOURS];
+        for (int hour = 0; hour < HOURS; hour++) {
+            start_hour[hour] = hour;
+            duration_hours[hour] = duration;
+            user_type[hour] = user->get_user_type();
+            styles[hour] = style;
+        }
+        Pricing::quote_batch(start_hour, duration_hours, user_type, styles, HOURS, due);
+        bool any = false;
+        for (int hour = 0; hour < HOURS; hour++) {
+            if (due[hour] >= 0) {
+                any = true;
+                cout << setw(2) << setfill('0') << hour << ":00 $" << setfill(' ') << due[hour] << "\n";
+            }
+        }
+        if (!any) {
+            cout << "No start time works for that booking.\n";
+        }
+    }
 
+    // maps the 1-4 menu choice to a meeting style
+    static MeetingStyle meeting_style_from_choice(int style_choice) {
         MeetingStyle meeting_style;
         switch (style_choice) {
             case 1:
@@ -112,47 +209,66 @@ public:
                 cout << "Invalid meeting style selected. Defaulting to Meeting." << endl;
                 meeting_style = Meeting;
         }
+        return meeting_style;
+    }
+
+    // turns the MM-DD-YYYY date and start hour a user typed into a time point
+    static time_point<system_clock> reservation_start(const string& date_str, int start_hour) {
+        int year = 1900, month = 1, day = 0; // what mktime made of an unreadable date
+        Calendar::parse_mdy(date_str, year, month, day);
+        return system_clock::time_point(seconds(Calendar::to_utc(year, month, day, start_hour)));
+    }
 
+    // reservation logic without the prompts, used by process_reservation, the server and the load driver
+    bool reserve_event(User* currentUser, const string& event_name, const time_point<system_clock>& start_time, int duration, bool pubpriv, bool open_to_non, MeetingStyle meeting_style, double cost_to_attend) {
+        METRICS_SCOPE(M_PROCESS_RESERVATION);
+        tick();
         // Set price based on user type
-        double price_per_hour = 10; // default for residents
-        if (currentUser->get_user_type() == NON_RESIDENT) {
-            price_per_hour = 15;
-        } else if (currentUser->get_user_type() == CITY) {
-            price_per_hour = 5;
-            if (meeting_style == Wedding) {
-                cout << "City events cannot be reserved with the Wedding style." << endl;
-                return; // Exit case if city tries to book a wedding
-            }
-        }
-
-        istringstream date_stream(date_str);
-        tm date_tm = {};
-        date_stream >> get_time(&date_tm, "%m-%d-%Y");
-        system_clock::time_point event_date = system_clock::from_time_t(mktime(&date_tm));
-        system_clock::time_point start_time = event_date + hours(start_hour);
-        system_clock::time_point end_time = start_time + hours(duration);
+        double price_per_hour = Pricing::hourly_rate(currentUser->get_user_type());
+        if (!Pricing::style_allowed(currentUser->get_user_type(), meeting_style)) {
+            cout << "City events cannot be reserved with the Wedding style." << endl;
+            return false; // Exit case if city tries to book a wedding
+        }
 
-        if (make_reservation(event_name, currentUser->get_user_name(), start_time, end_time, price_per_hour, pubpriv, open_to_non, meeting_style, cost_to_attend, currentUser, users)) {
-            cout << "Reservation created successfully.\n";
-        } else {
-            cout << "Failed to create reservation.\n";
+        if (!(fabs(cost_to_attend) <= MAX_PRICE)) {
+            cout << "The ticket price is too high." << endl;
+            return false;
         }
+
+        system_clock::time_point end_time = start_time + hours(duration);
+        bool reserved = make_reservation(event_name, currentUser->get_user_name(), start_time, end_time, price_per_hour, pubpriv, open_to_non, meeting_style, cost_to_attend, users);
+        if (reserved) {
+            schedule(*facility.find_event(event_name));
+            mutated();
+        }
+        return reserved;
     }
 
     // make the reservation
-    bool make_reservation(const string& event_name, const string& username, const time_point<system_clock>& start_time, const time_point<system_clock>& end_time, double price_per_hour, bool pubpriv, bool open_to_non, MeetingStyle style, double cost_to_attend, User* user, map<string, User> users) {
-        if (users.find(username) != users.end()) {
-            return facility.make_reservation(event_name, username, start_time, end_time, price_per_hour, pubpriv, open_to_non, style, cost_to_attend, user, users);
+    bool make_reservation(const string& event_name, const string& username, const time_point<system_clock>& start_time, const time_point<system_clock>& end_time, double price_per_hour, bool pubpriv, bool open_to_non, MeetingStyle style, double cost_to_attend, UserRegistry& users) {
+        if (loaded_event_lines.count(event_name) && !facility.find_event(event_name)) {
+            // the merge on save would take the new event for the cancelled one
+            cout << "An event called " << event_name << " was just cancelled, please choose another name." << endl;
+            return false;
+        }
+        if (users.find(username)) {
+            return facility.make_reservation(event_name, username, start_time, end_time, price_per_hour, pubpriv, open_to_non, style, cost_to_attend, users);
         }
         return false;
     }
     
-    void display_events_by_organizer(const string& organizer_username) {
+    void display_events_by_organizer(const string& organizer_username) const {
         facility.display_events_by_organizer(organizer_username);
     }
 
+    string display_events_by_organizer_page(const string& organizer_username, ListingOrder order, size_t page_size,
+                                            const string& cursor) const {
+        return facility.display_events_by_organizer_page(organizer_username, order, page_size, cursor);
+    }
+
     // process payment for a reservation
     void process_payement(User* currentUser) {
+        tick();
         string event_name;
         cout << "Enter the name of the event you wish to pay for: ";
         getline(cin, event_name);   
@@ -176,7 +292,7 @@ public:
         cin >> userConfirmation;
 
         if (toupper(userConfirmation) == 'Y') {
-            if (facility.process_payment(event_name, currentUser, total_cost)) {
+            if (pay_for_event(currentUser, event_name)) {
                 cout << "Payment successful and event confirmed." << endl;
             } else {
                 cout << "Payment failed." << endl;
@@ -186,19 +302,79 @@ public:
         }
     }
 
+    // cost to confirm a reservation, -1 if it does not exist or is already confirmed
+    double get_event_cost(const string& event_name) {
+        tick();
+        return facility.get_event_cost(event_name);
+    }
+
+    // pays for a reservation without prompting
+    bool pay_for_event(User* currentUser, const string& event_name) {
+        METRICS_SCOPE(M_PROCESS_PAYMENT);
+        tick();
+        double total_cost = facility.get_event_cost(event_name);
+        if (total_cost == -1 || currentUser->get_bank_balance() < total_cost) {
+            return false;
+        }
+        bool paid = facility.process_payment(event_name, currentUser, total_cost);
+        if (paid) {
+            mutated();
+        }
+        return paid;
+    }
+
+    // Reads an event name from a line the user types. A name in names that allowed says
+    // yes to is taken as it is; otherwise the closest of those are listed, and the user
+    // picks one by number or types again. Empty if nothing matches or the user enters nothing.
+    string read_event_name(const NameIndex& names, const function<bool(const string&)>& allowed = nullptr) {
+        static const size_t SHOWN = 10;
+        vector<NameMatch> shown;
+        string line;
+        while (getline(cin, line) && !line.empty()) {
+            if (names.contains(line) && (!allowed || allowed(line))) {
+                return line;
+            }
+            if (!shown.empty() && line.size() <= 2 && all_of(line.begin(), line.end(), ::isdigit)) {
+                size_t choice = stoul(line);
+                if (choice >= 1 && choice <= shown.size()) {
+                    return shown[choice - 1].name;
+                }
+            }
+            shown = names.match(line, SHOWN, allowed);
+            if (shown.empty()) {
+                cout << "No event matches \"" << line << "\".\n";
+                break;
+            }
+            cout << "Did you mean:\n";
+            for (size_t i = 0; i < shown.size(); i++) {
+                cout << "  " << i + 1 << ". " << shown[i].name << "\n";
+            }
+            cout << "Enter a number, type more of the name, or press enter to stop: ";
+        }
+        return "";
+    }
+
     // get which event the user wants to buy a ticket for
     void buy_ticket(User* currentUser) {
-        cout << "Buying a ticket! These are all of the available events:" << endl;
-        facility.display_available_events(currentUser);
-        string event_name;
-        cout << "Enter the event name in which you want to attend: \n";
+        cout << "Buying a ticket! Enter the name of the event you want to attend, or the start of it: \n";
         cout << "If the event is sold out you will automatically be added to the waitlist.\n";
-        getline(cin, event_name);
-        if (!facility.check_availability(event_name, currentUser)) {
+        string event_name = read_event_name(facility.get_name_index(),
+            [&](const string& name) { return facility.available_to(name, currentUser); });
+        if (event_name.empty()) {
+            cout << "Was not able to purchase ticket\n";
             return;
         }
-        if (facility.buy_ticket(event_name, currentUser)) {
-            facility.pay_organizer(event_name, currentUser, users);
+        int count;
+        cout << "How many tickets? Group bookings get seats next to each other: ";
+        cin >> count;
+        if (cin.fail()) {
+            cin.clear(); // Clear error state
+            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Ignore wrong input
+            cout << "Invalid input. Please enter a number.\n";
+            return;
+        }
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        if (buy_ticket(currentUser, event_name, count)) {
             cout << "Ticket purchase successful!\n";
         } else {
             cout << "Was not able to purchase ticket\n";
@@ -206,33 +382,113 @@ public:
         cout << "bye\n";
     }
 
+    // buys count seats together at the named event, joining the waitlist if it is sold out
+    bool buy_ticket(User* currentUser, const string& event_name, int count = 1) {
+        METRICS_SCOPE(M_BUY_TICKET);
+        tick();
+        bool bought = false;
+        if (count < 1) {
+            cout << "Buy at least one ticket.\n";
+            return false;
+        }
+        auto sale = sales.find(event_name);
+        if (sale != sales.end()) {
+            future<SaleOutcome> outcome = sale->second->submit(currentUser, count);
+            settle_sales();
+            return outcome.get() == SALE_BOUGHT;
+        }
+        if (facility.check_availability(event_name, currentUser) && facility.buy_ticket(event_name, currentUser, count)) {
+            facility.pay_organizer(event_name, users, count);
+            bought = true;
+        }
+        mutated(); // joining the waitlist is a change too
+        return bought;
+    }
+
+    // Puts a public event on sale: purchases for it are queued and settled in
+    // rounds instead of one at a time. Open it before the buyers arrive and
+    // close it once they are gone; in between any thread may call submit on
+    // what on_sale returns, while settle_sales needs the System to itself.
+    bool open_sale(const string& event_name) {
+        Event* event = facility.find_event(event_name);
+        if (!event || !event->is_public() || !event->is_open_to_non()) {
+            return false;
+        }
+        sales_changed |= sales.emplace(event_name, make_unique<OnSale>(event_name, event->tickets_left())).second;
+        return true;
+    }
+
+    OnSale* on_sale(const string& event_name) {
+        auto sale = sales.find(event_name);
+        return sale == sales.end() ? nullptr : sale->second.get();
+    }
+
+    void close_sale(const string& event_name) {
+        settle_sales();
+        sales_changed |= sales.erase(event_name) > 0;
+    }
+
+    // settles every queued purchase; returns how many there were
+    size_t settle_sales() {
+        size_t settled = 0;
+        for (auto& sale : sales) {
+            settled += facility.settle_sale(*sale.second, users);
+        }
+        if (settled > 0) {
+            mutated();
+        }
+        return settled;
+    }
+
     // what event the user wants to cancel their ticket for
     void cancel_ticket(User* currentUser) {
         cout << "Cancelling a ticket.\n";
-        string event_name;
-        cout << "Enter the name of the event you want to cancel your ticket for.\n";
-        cin >> event_name;
+        load_holdings(currentUser);
+        NameIndex held; // the user's own are few, so they get an index of their own
+        for (const Ticket& ticket : currentUser->get_tickets()) {
+            held.insert(ticket.get_event_name());
+        }
+        cout << "Enter the name of the event you want to cancel your ticket for, or the start of it.\n";
+        string event_name = read_event_name(held);
+        if (event_name.empty() || !cancel_ticket(currentUser, event_name)) {
+            cout << "It does not look like you have a ticket to this event\n";
+        }
+    }
+
+    // cancels the user's ticket to the named event
+    bool cancel_ticket(User* currentUser, const string& event_name) {
+        METRICS_SCOPE(M_CANCEL_TICKET);
+        tick();
         if (facility.find_ticket(event_name, currentUser)) {
             cout << "Cancelling your ticket\n"; 
-            facility.cancel_ticket(event_name, currentUser);
+            int tickets_left = facility.find_event(event_name)->tickets_left();
+            facility.cancel_ticket(event_name, currentUser, users);
             currentUser->cancel_ticket(event_name);
-            return;
+            if (OnSale* sale = on_sale(event_name)) {
+                sale->restock(facility.find_event(event_name)->tickets_left() - tickets_left);
+            }
+            mutated();
+            return true;
         }
-        cout << "It does not look like you have a ticket to this event\n";
+        return false;
     }
 
     // print the tickets that the user has
     void print_tickets(User* currentUser) {
+        load_holdings(currentUser);
         currentUser->print_tickets();
     }
 
     // cancel an event if the user is the organizer
     void cancel_event(User* currentUser){
         cout << "Cancelling a hosting event!" << endl;
-        string event_name;
-        cout<<"Enter the event name in which you host and want to cancel: "<<endl;
-        getline(cin, event_name);
-        if(facility.cancel_event(event_name, currentUser, users)){
+        NameIndex hosted;
+        for (size_t pos : facility.query(EventQuery().organized_by(currentUser->get_user_name()))) {
+            hosted.insert(facility.get_events()[pos].get_name());
+        }
+        cout<<"Enter the event name in which you host and want to cancel, or the start of it: "<<endl;
+        string event_name = read_event_name(hosted);
+        if(!event_name.empty() && cancel_event(currentUser, event_name)){
             cout << "Cancellation successful\n";
         } else {
             cout << "Cancellation unsuccessful\n";
@@ -240,16 +496,289 @@ public:
         cout << "bye\n";
     }
 
+    // cancels the named event on behalf of currentUser, who must be hosting it
+    bool cancel_event(User* currentUser, const string& event_name) {
+        METRICS_SCOPE(M_CANCEL_EVENT);
+        tick();
+        const Event* event = facility.find_event(event_name);
+        if (event && event->get_creator_username() != currentUser->get_user_name()) {
+            cout << "Only the organizer can cancel an event.\n";
+            return false;
+        }
+        bool cancelled = facility.cancel_event(event_name, currentUser, users);
+        if (cancelled) {
+            mutated();
+        }
+        return cancelled;
+    }
+
+    // lists the events currentUser can buy tickets for; safe alongside any other call
+    void browse_events(const User* currentUser) const {
+        facility.display_available_events(currentUser);
+    }
+
+    // browse_events a page at a time; returns the cursor for the next page, see
+    // Facility::print_schedule_page
+    string browse_events_page(const User* currentUser, ListingOrder order, size_t page_size, const string& cursor) const {
+        return facility.display_available_events_page(currentUser, order, page_size, cursor);
+    }
+
+    Facility& get_facility() {
+        return facility;
+    }
+
+    const UserRegistry& get_users() const {
+        return users;
+    }
+
 
 private:
+    static int64_t now_seconds() {
+        return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    static int64_t start_seconds(const Event& event) {
+        return duration_cast<seconds>(event.get_start_time().time_since_epoch()).count();
+    }
+
+    // when a deadline of event comes due
+    static int64_t due(Deadline::Kind kind, const Event& event) {
+        const int64_t day = 60 * 60 * 24;
+        switch (kind) {
+            case Deadline::OVERRIDE_LOCK: // the last second with more than override_lock_days whole days to go
+                return start_seconds(event) - (PricingRules::override_lock_days + 1) * day + 1;
+            case Deadline::LATE_CANCELLATION: // less than late_cancellation_days whole days to go
+                return start_seconds(event) - PricingRules::late_cancellation_days * day + 1;
+            case Deadline::START:
+                return start_seconds(event);
+            default:
+                return duration_cast<seconds>(event.get_end_time().time_since_epoch()).count();
+        }
+    }
+
+    void schedule(const Event& event, Deadline::Kind kind = Deadline::OVERRIDE_LOCK) {
+        deadlines.add(due(kind, event), Deadline{kind, event.get_name(), start_seconds(event)});
+    }
+
+    // applies a deadline that came due and schedules the event's next one
+    void handle(const Deadline& deadline) {
+        Event* event = facility.find_event(deadline.event_name);
+        if (!event || start_seconds(*event) != deadline.start) {
+            return; // cancelled, or lost a merge, since it was scheduled
+        }
+        switch (deadline.kind) {
+            case Deadline::OVERRIDE_LOCK:
+                event->lock_override();
+                break;
+            case Deadline::LATE_CANCELLATION:
+                event->start_late_cancellation();
+                break;
+            case Deadline::START:
+                if (!event->is_confirmed()) {
+                    facility.expire_hold(deadline.event_name, users);
+                    mutated();
+                    return;
+                }
+                facility.close_waitlist(*event);
+                mutated();
+                break;
+            case Deadline::END:
+                ended.insert(deadline.event_name);
+                mutated();
+                return;
+        }
+        schedule(*event, static_cast<Deadline::Kind>(deadline.kind + 1));
+    }
+
+    void save_all() {
+        save_events("events_data.csv");
+        save_waitlists();
+        save_users_to_file("users.csv"); // last, merging may have refunded somebody
+        facility.save_budget();
+        facility.save_penalties();
+        if (sales_changed) {
+            save_sales("on_sale.txt");
+        }
+    }
+
+    // the events on sale when the file was last saved, one name a line
+    void load_sales(const string& filename) {
+        string content;
+        if (read_file(filename, content)) {
+            for (string_view line : split_lines(content)) {
+                open_sale(string(line));
+            }
+        }
+        sales_changed = false;
+    }
+
+    // Only a process that opened or closed a sale writes the file, so the others
+    // leave alone what it did. An event that is gone since takes its sale with it.
+    void save_sales(const string& filename) {
+        string content;
+        for (const auto& sale : sales) {
+            if (facility.find_event(sale.first)) {
+                content += sale.first;
+                content += '\n';
+            }
+        }
+        write_file_atomically(filename, content);
+    }
+
+    // every entry point that changes state ends here; starts a background save when one is due
+    void mutated() {
+        facility.publish_schedule();
+        checkpointer.mutated();
+        if (checkpointer.failed()) {
+            cerr << "Background save failed, saving now.\n";
+            save();
+            checkpointer.saved();
+        } else if (checkpointer.due() && !checkpointer.start([this] { save_checkpoint(); })) {
+            save(); // other threads are running, see Checkpointer
+            checkpointer.saved();
+        }
+    }
+
+    // Runs in the checkpoint child. The base it leaves behind describes memory as it was
+    // at the fork, which is what the parent still has: balances and the budget from
+    // before any merge refunds, and the events the merge dropped, which the parent
+    // drops too without refunding them again.
+    // Nothing it writes shows until all of it is written, base included, so if it fails
+    // the parent's own base still matches the files; see Checkpointer::failed.
+    void save_checkpoint() {
+        FileLock lock(STATE_LOCK_FILE, true);
+        StagedWrites staged;
+        adopt_checkpoint_base();
+        map<string, double> balances;
+        for (UserHandle handle = 0; handle < users.size(); handle++) {
+            balances[users.get(handle)->get_user_name()] = users.get(handle)->get_bank_balance();
+        }
+        double budget = facility.get_budget();
+        vector<string> names;
+        for (const Event& event : facility.get_events()) {
+            names.push_back(event.get_name());
+        }
+        save_all();
+
+        string content;
+        append_number(content, budget);
+        content += "\nP,";
+        append_number(content, (long long)facility.get_penalties_saved());
+        content += '\n';
+        for (const auto& pair : balances) {
+            content += "U,";
+            content += pair.first;
+            content += ',';
+            append_number(content, pair.second);
+            content += '\n';
+        }
+        for (const auto& pair : loaded_event_lines) {
+            content += "E,";
+            content += pair.second;
+            content += '\n';
+        }
+        for (const auto& pair : loaded_waitlists) {
+            content += "W,";
+            content += pair.first;
+            for (const string& username : pair.second) {
+                content += ',';
+                content += username;
+            }
+            content += '\n';
+        }
+        for (const string& name : names) {
+            if (!facility.find_event(name)) {
+                content += "D,";
+                content += name;
+                content += '\n';
+            }
+        }
+        write_file_atomically(checkpoint_base_file, content);
+        if (!staged.commit()) {
+            throw runtime_error("checkpoint not written");
+        }
+    }
+
+    // takes over the merge base a finished checkpoint left behind; caller holds the state lock
+    void adopt_checkpoint_base() {
+        string content;
+        if (!read_file(checkpoint_base_file, content)) {
+            return;
+        }
+        vector<string_view> lines = split_lines(content);
+        if (lines.empty()) {
+            return;
+        }
+        double budget = 0;
+        from_chars(lines[0].data(), lines[0].data() + lines[0].size(), budget);
+        facility.set_loaded_budget(budget);
+        // balances and waitlists this process loaded after the fork are not in the file, keep them
+        loaded_event_lines.clear();
+        for (size_t i = 1; i < lines.size(); i++) {
+            string_view tag = first_field(lines[i]);
+            string_view rest = lines[i].substr(min(lines[i].size(), tag.size() + 1));
+            if (tag == "U") {
+                string_view name = first_field(rest);
+                string_view value = rest.substr(min(rest.size(), name.size() + 1));
+                double balance = 0;
+                from_chars(value.data(), value.data() + value.size(), balance);
+                loaded_balances[string(name)] = balance;
+            } else if (tag == "P") {
+                long long count = 0;
+                from_chars(rest.data(), rest.data() + rest.size(), count);
+                facility.set_penalties_saved(count);
+            } else if (tag == "E") {
+                loaded_event_lines[string(first_field(rest))] = string(rest);
+            } else if (tag == "W") {
+                vector<string>& names = loaded_waitlists[string(first_field(rest))];
+                names.clear();
+                size_t begin = first_field(rest).size();
+                while (begin < rest.size()) {
+                    string_view username = first_field(rest.substr(begin + 1));
+                    names.emplace_back(username);
+                    begin += username.size() + 1;
+                }
+            } else if (tag == "D" && facility.find_event(string(rest))) {
+                drop_event(string(rest));
+            }
+        }
+    }
+
+    // bases left by processes that died before their final save; a new process may reuse the pid
+    static void remove_stale_checkpoint_bases() {
+        DIR* dir = opendir(".");
+        if (!dir) {
+            return;
+        }
+        const string prefix = ".checkpoint.";
+        while (dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            pid_t pid = atoi(name.c_str() + prefix.size());
+            if (pid == getpid() || (kill(pid, 0) != 0 && errno == ESRCH)) {
+                remove(name.c_str());
+            }
+        }
+        closedir(dir);
+    }
+
 //csv style loading events and tickets
     void load_events(const string& data_file) {
+        METRICS_SCOPE(M_LOAD_EVENTS);
         ifstream file(data_file);
         string line;
         while (getline(file, line)) {
-            stringstream ss(line);
+            // the ten header fields; what follows is the tickets
+            size_t header_end = 0;
+            for (int field = 0; field < EventRecord::TICKETS_BEGIN && header_end != string::npos; field++) {
+                header_end = line.find(',', header_end + (field > 0));
+            }
+            header_end = min(header_end, line.size());
+            stringstream ss(line.substr(0, header_end));
             string name, creator, start_str, end_str, style_str, pubpriv_str, open_str, confirmed_str;
-            int price_per_hour, cost_to_attend;
+            double price_per_hour, cost_to_attend; // whole dollars in older files
             getline(ss, name, ',');
             getline(ss, creator, ',');
             getline(ss, start_str, ',');
@@ -268,123 +797,544 @@ private:
             MeetingStyle style = static_cast<MeetingStyle>(stoi(style_str));
             bool confirmed = confirmed_str == "1";
 
-            Event loaded_event(name, creator, start, end, price_per_hour, pubpriv, open_to_non, style, cost_to_attend);
+            // tickets stay unparsed until the event is used, and so do the users' holdings
+            Event loaded_event(name, creator, start, end, price_per_hour, pubpriv, open_to_non, style, cost_to_attend, line.substr(header_end));
             if (confirmed) {
                 loaded_event.confirm();
             }
-
-            while (ss.good()) {
-                string ticket_price_str, ticket_holder, ticket_purchased_str;
-                getline(ss, ticket_price_str, ',');
-                getline(ss, ticket_holder, ',');
-                getline(ss, ticket_purchased_str, ',');
-                if (!ticket_price_str.empty() && !ticket_holder.empty() && !ticket_purchased_str.empty()) {
-                    int ticket_price = stoi(ticket_price_str);
-                    bool ticket_purchased = stoi(ticket_purchased_str) == 1;
-                    Ticket ticket(name, ticket_price, ticket_holder);
-                    ticket.set_purchased(ticket_purchased);
-                    loaded_event.load_ticket(ticket);
-                    // Assign ticket to user if the user exists
-                        auto user_it = users.find(ticket_holder);
-                        if (user_it != users.end()) {
-                            user_it->second.add_ticket(ticket); // Assume addTicket takes a pointer
-                        } else {
-                            // Optionally handle or log if no such user exists
-                            cout << "No user found for username: " << ticket_holder << endl;
-                        }
-                }
-            }
+            loaded_event.defer_waitlist();
 
             facility.add_event(loaded_event);
+            schedule(loaded_event);
+            loaded_event_lines[name] = line;
         }
         file.close();
     }
 
+    // appends one events_data.csv line, no stream or temporary strings involved
+    static void append_event_line(string& out, const Event& event) {
+        out += event.get_name();
+        out += ',';
+        out += event.get_creator_username();
+        out += ',';
+        append_number(out, (long long)duration_cast<seconds>(event.get_start_time().time_since_epoch()).count());
+        out += ',';
+        append_number(out, (long long)duration_cast<seconds>(event.get_end_time().time_since_epoch()).count());
+        out += ',';
+        append_number(out, event.get_price_per_hour());
+        out += event.is_public() ? ",1" : ",0";
+        out += event.is_open_to_non() ? ",1," : ",0,";
+        append_number(out, (long long)event.get_meeting_style());
+        out += event.is_confirmed() ? ",1," : ",0,";
+        append_number(out, event.get_cost_to_attend());
+
+        // Serialize tickets, or copy them through if they were never parsed
+        if (!event.tickets_loaded()) {
+            out += event.get_ticket_section();
+            return;
+        }
+        for (const Ticket& ticket : event.get_tickets()) {
+            out += ',';
+            append_number(out, ticket.get_cost());
+            out += ',';
+            out += ticket.get_owner();
+            out += ticket.is_purchased() ? ",1" : ",0";
+        }
+    }
+
+    static string event_line(const Event& event) {
+        string line;
+        append_event_line(line, event);
+        return line;
+    }
+
+    vector<string> waitlist_names(const Event& event) const {
+        vector<string> names;
+        for (UserHandle handle : event.get_waitlist()) {
+            names.push_back(users.get(handle)->get_user_name());
+        }
+        return names;
+    }
+
+    bool same_waitlist(const Event& event, const vector<string>& names) const {
+        const auto& waitlist = event.get_waitlist();
+        if (waitlist.size() != names.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            if (users.get(waitlist[i])->get_user_name() != names[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // waitlists never loaded from their files are unchanged and left alone
+    void write_waitlist(const Event& event) {
+        if (event.waitlist_loaded()) {
+            waitlists_to_write[event.get_name()] = waitlist_names(event);
+        }
+    }
+
+    // what was just written for an event is the base for the next save
+    void rebase(const Event& event) {
+        loaded_event_lines[event.get_name()] = event_line(event);
+        if (event.waitlist_loaded()) {
+            loaded_waitlists[event.get_name()] = waitlist_names(event);
+        }
+    }
+
+    static string waitlist_file(const string& event_name) {
+        return "waitlist/waitlist_" + event_name + ".csv";
+    }
+
+    // money owed back after a merge; users this session never loaded are settled on disk only
+    void refund(const string& username, double amount) {
+        if (User* user = users.find(username)) {
+            user->get_payment(amount);
+        } else {
+            merge_refunds[username] += amount;
+        }
+    }
+
+    // a ticket sale undone by a merge: the holder gets the price back from the organizer
+    void refund_ticket(const EventRecord& event, const string& holder) {
+        refund(holder, event.cost_to_attend());
+        refund(event.creator(), -event.cost_to_attend());
+    }
+
+    // Seat by seat: whichever side changed a seat since the base wins it. A seat both
+    // sides sold goes to theirs, and our buyer moves to a free seat or is refunded.
+    vector<string> merge_seats(const EventRecord& base, const EventRecord& ours, const EventRecord& theirs) {
+        vector<string> base_seats = base.seat_holders(), our_seats = ours.seat_holders(), seats = theirs.seat_holders();
+        vector<string> bumped;
+        for (size_t i = 0; i < our_seats.size(); i++) {
+            const string& was = i < base_seats.size() ? base_seats[i] : string();
+            if (our_seats[i] == was) {
+                continue;
+            }
+            if (i >= seats.size()) {
+                seats.resize(i + 1);
+            }
+            if (seats[i] == was) {
+                seats[i] = our_seats[i];
+            } else if (!our_seats[i].empty()) {
+                bumped.push_back(our_seats[i]);
+            }
+        }
+        for (const string& holder : bumped) {
+            auto free_seat = find(seats.begin(), seats.end(), string());
+            if (free_seat != seats.end()) {
+                *free_seat = holder;
+            } else {
+                refund_ticket(ours, holder); // oversold between the two sessions
+            }
+        }
+        return seats;
+    }
+
+    // an event whose changes lost a merge and was refunded: forget it here too
+    void drop_event(const string& name) {
+        for (const string& holder : EventRecord(event_line(*facility.find_event(name))).holders()) {
+            if (User* user = users.find(holder)) {
+                user->remove_tickets_for(name);
+            }
+        }
+        facility.remove_event(name);
+        loaded_event_lines.erase(name);
+        loaded_waitlists.erase(name);
+        ended.erase(name);
+    }
+
+    // Merges this process's changes into what is on disk now; must hold the exclusive state lock.
+    // Unchanged events keep their disk line as is, so a save only serializes what changed and
+    // does not allocate per event. Afterwards what was written becomes the new merge base.
     void save_events(const string& data_file) {
-        ofstream file(data_file);
+        METRICS_SCOPE(M_SAVE_EVENTS);
+        string disk;
+        read_file(data_file, disk);
+        vector<string_view> disk_lines = split_lines(disk);
+        LineIndex on_disk(disk_lines);
+
+        struct LineAction {
+            const Event* ours = nullptr; // write our version of the event
+            int merged = -1;             // write merged_lines[merged]
+            bool drop = false;
+        };
+        vector<LineAction> actions(disk_lines.size());
+        vector<string> merged_lines;
+        vector<const Event*> created;        // new events to append
+        vector<string> dropped;              // lost a merge, removed here after the loop
+        vector<EventRecord> saved_elsewhere; // events other sessions created after we loaded
+        bool scanned_elsewhere = false;
+        waitlists_to_write.clear();
+
+        string line; // reused for every event
         for (const Event& event : facility.get_events()) {
-            file << event.get_name() << ","
-                << event.get_creator_username() << ","
-                << duration_cast<seconds>(event.get_start_time().time_since_epoch()).count() << ","
-                << duration_cast<seconds>(event.get_end_time().time_since_epoch()).count() << ","
-                << event.get_price_per_hour() << ","
-                << event.is_public() << ","
-                << event.is_open_to_non() << ","
-                << static_cast<int>(event.get_meeting_style()) << ","
-                << event.is_confirmed() << ","
-                << event.get_cost_to_attend();
-
-            // Serialize tickets
-            for (const Ticket& ticket : event.get_tickets()) {
-                file << "," << ticket.get_cost() << ","
-                    << ticket.get_owner() << ","
-                    << ticket.is_purchased();
-            }
-            file << "\n";
+            const string& name = event.get_name();
+            line.clear();
+            append_event_line(line, event);
+            auto base = loaded_event_lines.find(name);
+            auto base_waitlist = loaded_waitlists.find(name);
+            bool same_waitlist_as_base = !event.waitlist_loaded() // still in its file, so unchanged
+                || (base_waitlist == loaded_waitlists.end() ? event.get_waitlist().empty() : same_waitlist(event, base_waitlist->second));
+            bool archiving = ended.count(name) > 0; // whatever version is written goes to the archive
+            if (base != loaded_event_lines.end() && base->second == line && same_waitlist_as_base && !archiving) {
+                continue; // untouched here, whatever is on disk wins
+            }
+            size_t disk_pos = on_disk.find(name);
+
+            if (base == loaded_event_lines.end()) {
+                // created here: another process may have taken the name or the time slot meanwhile
+                if (!scanned_elsewhere) {
+                    for (string_view disk_line : disk_lines) {
+                        auto loaded = loaded_event_lines.find(string(first_field(disk_line)));
+                        if (loaded == loaded_event_lines.end()
+                            || !EventRecord(loaded->second).same_reservation(EventRecord(disk_line))) {
+                            saved_elsewhere.emplace_back(disk_line);
+                        }
+                    }
+                    scanned_elsewhere = true;
+                }
+                EventRecord ours(line);
+                bool clash = disk_pos != LineIndex::npos;
+                for (size_t i = 0; i < saved_elsewhere.size() && !clash; i++) {
+                    clash = ours.overlaps(saved_elsewhere[i]);
+                }
+                if (clash) {
+                    cerr << "Reservation " << name << " clashes with one saved by another session, refunding it.\n";
+                    if (ours.confirmed()) {
+                        refund(event.get_creator_username(), ours.amount_due());
+                        facility.adjust_budget(-ours.amount_due());
+                    }
+                    for (const string& holder : ours.holders()) {
+                        refund_ticket(ours, holder);
+                    }
+                    dropped.push_back(name);
+                    continue;
+                }
+                created.push_back(&event);
+                write_waitlist(event);
+                continue;
+            }
+
+            EventRecord base_record(base->second), ours(line);
+            if (disk_pos == LineIndex::npos || !base_record.same_reservation(EventRecord(disk_lines[disk_pos]))) {
+                // cancelled by another session, which refunded the tickets and the payment it knew about;
+                // the name may have been booked again since
+                for (const string& holder : subtract_names(ours.holders(), base_record.holders())) {
+                    refund_ticket(ours, holder);
+                }
+                if (ours.confirmed() && !base_record.confirmed()) {
+                    refund(event.get_creator_username(), ours.amount_due());
+                    facility.adjust_budget(-ours.amount_due());
+                }
+                dropped.push_back(name);
+                continue;
+            }
+
+            static const vector<string> no_waitlist;
+            const vector<string>& loaded_waitlist = base_waitlist == loaded_waitlists.end() ? no_waitlist : base_waitlist->second;
+            vector<string> disk_waitlist;
+            if (event.waitlist_loaded()) {
+                disk_waitlist = read_lines(waitlist_file(name));
+            }
+            if (disk_lines[disk_pos] == base->second && disk_waitlist == loaded_waitlist) {
+                actions[disk_pos].ours = &event; // nobody else touched it
+                write_waitlist(event);
+                continue;
+            }
+
+            // both sides changed the event: merge the seats and the waitlist
+            EventRecord theirs(disk_lines[disk_pos]);
+            theirs.set_seat_holders(merge_seats(base_record, ours, theirs));
+            theirs.set_confirmed(theirs.confirmed() || (ours.confirmed() && !base_record.confirmed()));
+            actions[disk_pos].merged = merged_lines.size();
+            merged_lines.push_back(theirs.to_line());
+            if (event.waitlist_loaded()) {
+                waitlists_to_write[name] = merge_names(loaded_waitlist, waitlist_names(event), disk_waitlist);
+            }
+        }
+
+        // events cancelled here: loaded, but no longer in the facility
+        vector<string_view> current;
+        current.reserve(facility.get_events().size());
+        for (const Event& event : facility.get_events()) {
+            current.push_back(event.get_name());
+        }
+        sort(current.begin(), current.end());
+        for (auto it = loaded_event_lines.begin(); it != loaded_event_lines.end(); ) {
+            if (binary_search(current.begin(), current.end(), string_view(it->first))) {
+                ++it;
+                continue;
+            }
+            size_t disk_pos = on_disk.find(it->first);
+            EventRecord base_record(it->second);
+            if (disk_pos != LineIndex::npos && base_record.same_reservation(EventRecord(disk_lines[disk_pos]))) {
+                // refund tickets other sessions sold after we loaded, and a payment one made
+                EventRecord theirs(disk_lines[disk_pos]);
+                for (const string& holder : subtract_names(theirs.holders(), base_record.holders())) {
+                    refund_ticket(theirs, holder);
+                }
+                if (theirs.confirmed() && !base_record.confirmed()) {
+                    refund(theirs.creator(), theirs.amount_due());
+                    facility.adjust_budget(-theirs.amount_due());
+                }
+                actions[disk_pos].drop = true;
+            } else {
+                // cancelled by another session too, which already refunded the payment and kept
+                // a penalty: take back ours
+                double penalty = 0;
+                if (base_record.confirmed() && facility.take_back_penalty(it->first, penalty)) {
+                    refund(base_record.creator(), penalty - base_record.amount_due());
+                    facility.adjust_budget(base_record.amount_due() - penalty);
+                }
+            }
+            loaded_waitlists.erase(it->first);
+            it = loaded_event_lines.erase(it);
+        }
+
+        // events that ended go to the archive instead, as report --archive-before does
+        string content, archive;
+        vector<string> archived;
+        content.reserve(disk.size() + disk.size() / 8 + 4096);
+        for (size_t i = 0; i < disk_lines.size(); i++) {
+            const LineAction& action = actions[i];
+            if (action.drop) {
+                continue;
+            }
+            string_view name = first_field(disk_lines[i]);
+            bool archiving = (action.ours || action.merged >= 0) && ended.count(name);
+            string& out = archiving ? archive : content;
+            if (action.ours) {
+                append_event_line(out, *action.ours);
+            } else if (action.merged >= 0) {
+                out += merged_lines[action.merged];
+            } else {
+                out += disk_lines[i];
+            }
+            out += '\n';
+            if (archiving) {
+                archived.emplace_back(name);
+            }
+        }
+        for (const Event* event : created) {
+            bool archiving = ended.count(event->get_name());
+            append_event_line(archiving ? archive : content, *event);
+            (archiving ? archive : content) += '\n';
+            if (archiving) {
+                archived.push_back(event->get_name());
+            }
+        }
+        // archive first: if we stop in between, an event is in both files rather than neither
+        if (!archive.empty() && !append_to_file(EVENT_ARCHIVE_FILE, archive)) {
+            content += archive; // try again next save
+            archived.clear();
+        }
+        write_file_atomically(data_file, content);
+
+        // what we wrote is the base for the next save
+        sort(archived.begin(), archived.end());
+        auto was_archived = [&](const string& name) { return binary_search(archived.begin(), archived.end(), name); };
+        for (size_t i = 0; i < disk_lines.size(); i++) {
+            if (actions[i].ours || actions[i].merged >= 0) {
+                const Event& event = actions[i].ours ? *actions[i].ours : *facility.find_event(string(first_field(disk_lines[i])));
+                if (!was_archived(event.get_name())) {
+                    rebase(event);
+                }
+            }
+        }
+        for (const Event* event : created) {
+            if (!was_archived(event->get_name())) {
+                rebase(*event);
+            }
+        }
+        for (const string& name : dropped) {
+            drop_event(name);
+        }
+        for (const string& name : archived) {
+            drop_event(name);
         }
-        file.close();
     }
 
 //csv style loading and saving users
     void load_users_from_file(const string& filename) {
+        METRICS_SCOPE(M_LOAD_USERS);
         ifstream file(filename);
         string line;
         while (getline(file, line)) {
             stringstream linestream(line);
             string name;
-            int balance;
-            int type;
+            double balance = 0;
+            int type = NON_RESIDENT;
             getline(linestream, name, ',');
-            linestream >> balance >> type;
-            users[name] = User(name, balance, static_cast<USER_TYPE>(type));
+            linestream >> balance;
+            linestream.ignore(); // skip the comma before the type
+            linestream >> type;
+            pair<User*, bool> user = users.create(name, balance, to_user_type(type));
+            if (!user.second) {
+                *user.first = User(name, balance, to_user_type(type)); // listed twice, the last line wins
+                user.first->set_handle(users.handle_of(name));
+            }
+            user.first->defer_tickets(); // see load_holdings
+            loaded_balances[name] = balance;
         }
     }
 
+    // balances merge as deltas against what we loaded, so concurrent sessions never lose a payment
     void save_users_to_file(const string& filename) {
-        ofstream file(filename);
-        for (const auto& pair : users) {
-            const User& user = pair.second;
-            file << user.get_user_name() << ',' << user.get_bank_balance() << ',' << static_cast<int>(user.get_user_type()) << '\n';
+        METRICS_SCOPE(M_SAVE_USERS);
+        struct Row {
+            string_view name;
+            double balance;
+            int type;
+        };
+        string disk;
+        read_file(filename, disk);
+        vector<Row> rows;
+        for (string_view line : split_lines(disk)) {
+            Row row{first_field(line), 0, 0};
+            if (row.name.size() == line.size()) {
+                continue;
+            }
+            const char* p = line.data() + row.name.size() + 1;
+            const char* end = line.data() + line.size();
+            p = from_chars(p, end, row.balance).ptr;
+            if (p < end && *p == ',') {
+                from_chars(p + 1, end, row.type);
+            }
+            rows.push_back(row);
         }
-    }
+        sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.name < b.name; });
 
-//csv style saving and loading waitlists in a waitlist directory.
-void load_waitlists() {
-        auto& events = facility.get_events();
-        for (auto& event : events) {
-            string filename = "waitlist/waitlist_" + event.get_name() + ".csv";
-            ifstream file(filename);
-            if (!file.is_open()) {
-                cerr << "Failed to open waitlist file: " << filename << endl;
+        // walk the disk rows and our users together, both sorted by name
+        string content;
+        content.reserve(disk.size() + users.size() * 8 + 4096);
+        auto write_row = [&](string_view name, double balance, int type) {
+            content += name;
+            content += ',';
+            append_number(content, balance);
+            content += ',';
+            append_number(content, (long long)type);
+            content += '\n';
+        };
+        auto owed = [&](string_view name) {
+            auto it = merge_refunds.find(name);
+            return it == merge_refunds.end() ? 0.0 : it->second;
+        };
+        vector<User*> ours = users.by_name();
+        size_t r = 0;
+        auto user = ours.begin();
+        while (r < rows.size() || user != ours.end()) {
+            if (user == ours.end() || (r < rows.size() && rows[r].name < (*user)->get_user_name())) {
+                write_row(rows[r].name, rows[r].balance + owed(rows[r].name), rows[r].type); // only on disk
+                r++;
                 continue;
             }
-            string username;
-            while (getline(file, username)) {
-                User* user = login_user(username);
-                if (user) {
-                    event.join_waitlist(user);
+            const string& name = (*user)->get_user_name();
+            double balance = (*user)->get_bank_balance();
+            if (r < rows.size() && rows[r].name == name) {
+                auto loaded = loaded_balances.find(name);
+                balance = rows[r].balance + owed(rows[r].name) + (balance - (loaded == loaded_balances.end() ? balance : loaded->second));
+                r++;
+            }
+            write_row(name, balance, static_cast<int>((*user)->get_user_type()));
+            ++user;
+        }
+        write_file_atomically(filename, content);
+
+        // what we wrote is the base for the next save
+        for (User* saved : ours) {
+            loaded_balances[saved->get_user_name()] = saved->get_bank_balance();
+        }
+        merge_refunds.clear();
+    }
+
+//csv style loading waitlists from a waitlist directory, one event at a time as Facility needs them
+void load_waitlist(Event& event) {
+        METRICS_SCOPE(M_LOAD_WAITLISTS);
+        vector<UserHandle> waitlist;
+        vector<string>& loaded = loaded_waitlists[event.get_name()];
+        loaded.clear();
+        string filename = waitlist_file(event.get_name());
+        ifstream file(filename);
+        if (!file.is_open()) {
+            cerr << "Failed to open waitlist file: " << filename << endl;
+        }
+        string username;
+        while (getline(file, username)) {
+            UserHandle user = users.handle_of(username);
+            if (user != NO_USER) {
+                waitlist.push_back(user);
+                loaded.push_back(username);
+            }
+        }
+        event.set_waitlist(move(waitlist));
+    }
+
+    // Works out a loaded user's tickets the first time they are needed. Events that were
+    // used since loading know their holders; for the rest, the holdings index says who held
+    // what when the file was loaded, which is still true for an event nobody touched.
+    void load_holdings(User* user) {
+        if (user->tickets_loaded()) {
+            return;
+        }
+        if (!holdings_indexed) {
+            for (const Event& event : facility.get_events()) {
+                if (!event.tickets_loaded()) {
+                    index_holdings(event);
+                }
+            }
+            holdings_indexed = true;
+        }
+        vector<Ticket> tickets;
+        auto indexed = holdings_index.find(user->get_user_name());
+        for (const Event& event : facility.get_events()) {
+            if (event.tickets_loaded()) {
+                for (const Ticket& ticket : event.get_tickets()) {
+                    if (ticket.get_owner() == user->get_user_name()) {
+                        tickets.push_back(ticket);
+                    }
+                }
+            } else if (indexed != holdings_index.end()) {
+                for (const Ticket& ticket : indexed->second) {
+                    if (ticket.get_event_name() == event.get_name()) {
+                        tickets.push_back(ticket);
+                    }
                 }
             }
-            file.close();
+        }
+        user->set_tickets(move(tickets));
+        if (indexed != holdings_index.end()) {
+            holdings_index.erase(indexed);
         }
     }
 
+    // adds an event's unparsed tickets to the holdings index
+    void index_holdings(const Event& event) {
+        for_each_ticket_field(event.get_ticket_section(), [&](string_view price, string_view owner, string_view purchased) {
+            if (price.empty() || owner.empty() || purchased.empty()) {
+                return;
+            }
+            double cost = 0;
+            from_chars(price.data(), price.data() + price.size(), cost);
+            Ticket ticket(event.get_name(), cost, string(owner));
+            ticket.set_purchased(purchased == "1");
+            holdings_index[string(owner)].push_back(move(ticket));
+        });
+    }
+
+// only the waitlists save_events decided to write
 void save_waitlists() {
-        const auto& events = facility.get_events();
-        for (const auto& event : events) {
-            string filename = "waitlist/waitlist_" + event.get_name() + ".csv";
-            ofstream file(filename);
-            if (!file.is_open()) {
-                cerr << "Failed to open waitlist file for writing: " << filename << endl;
-                continue;
+        METRICS_SCOPE(M_SAVE_WAITLISTS);
+        for (const auto& pair : waitlists_to_write) {
+            string content;
+            for (const string& username : pair.second) {
+                content += username + '\n';
             }
-            const auto& waitlist = event.get_waitlist();
-            for (const auto* user : waitlist) {
-                if (user) {
-                    file << user->get_user_name() << '\n';
-                }
+            if (!write_file_atomically(waitlist_file(pair.first), content)) {
+                cerr << "Failed to open waitlist file for writing: " << waitlist_file(pair.first) << endl;
             }
-            file.close();
         }
     }
 
@@ -4,46 +4,47 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <string_view>
+#include "money.hpp"
+#include "name_table.hpp"
 
 using namespace std;
 
+// names are NameTable ids, so a seat's ticket is 16 bytes
 class Ticket {
-    string eventName;
-    double cost; // could use float double if we want
-    string owner_name;
+    uint32_t event_id;
+    Cents cost;
+    uint32_t owner_id;
     bool been_purchased;
     
 public:
-    Ticket(const string& name, double price) : eventName(name), cost(price) {
+    Ticket(const string& name, double price) : event_id(NameTable::intern(name)), cost(to_cents(price)), owner_id(NameTable::intern("")) {
         been_purchased = false;
     }
 
-    Ticket(string name, double price, string owner){
+    Ticket(const string& name, double price, const string& owner) : event_id(NameTable::intern(name)), cost(to_cents(price)), owner_id(NameTable::intern(owner)) {
         been_purchased = true;
-        eventName = name;
-        cost = price;
-        owner_name = owner;
     }
 
     // Standard getters and setters
-    string get_event_name() const {
-        return eventName;
+    const string& get_event_name() const {
+        return NameTable::name(event_id);
     }
 
     double get_cost() const {
-        return cost;
+        return to_dollars(cost);
     }
     
     void set_cost(double new_cost) {
-        cost = new_cost;
+        cost = to_cents(new_cost);
     }
 
-    string get_owner() const {
-        return owner_name;
+    const string& get_owner() const {
+        return NameTable::name(owner_id);
     }
 
     void set_owner(const string& newOwner) {
-        owner_name = newOwner;
+        owner_id = NameTable::intern(newOwner);
     }
 
     bool is_purchased() const {
@@ -55,6 +56,24 @@ public:
     }
 };
 
+// Calls f(price, owner, purchased) for each ticket in the part of an events_data.csv
+// line after the event header: ",price,owner,purchased" repeated, owner blank if unsold.
+template <typename F>
+void for_each_ticket_field(string_view section, F f) {
+    auto next_field = [&section]() {
+        section.remove_prefix(1); // the comma before the field
+        string_view field = section.substr(0, section.find(','));
+        section.remove_prefix(field.size());
+        return field;
+    };
+    while (!section.empty()) {
+        string_view price = next_field();
+        string_view owner = section.empty() ? string_view() : next_field();
+        string_view purchased = section.empty() ? string_view() : next_field();
+        f(price, owner, purchased);
+    }
+}
+
 #endif // TICKET_TICKET_HPP
 
  
@@ -0,0 +1,129 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+// Hierarchical timing wheel with one second ticks. Level 0 has a slot per
+// second of the current 64 second block, level 1 a slot per 64 seconds of the
+// current 4096 second block, and so on up to about 34 years; anything further
+// out waits in an overflow list. A timer lives in the level of the highest
+// block boundary between now and its deadline, and moves down a level each
+// time the wheel reaches that block, so it is touched at most once per level
+// before it fires. Stretches with nothing due are skipped a block at a time.
+template <typename T>
+class TimingWheel {
+    static const int LEVELS = 5;
+    static const int BITS = 6; // 64 slots a level
+    static const int SLOTS = 1 << BITS;
+
+    struct Timer {
+        int64_t due;
+        T payload;
+    };
+
+    vector<Timer> slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS] = {}; // bit s: slots[level][s] is not empty
+    vector<Timer> overflow;
+    vector<Timer> overdue; // added with a deadline already passed, fire on the next advance
+    int64_t current;       // every tick up to here has been handled
+    size_t count = 0;
+
+    void place(Timer timer) {
+        if (timer.due <= current) {
+            overdue.push_back(move(timer));
+            return;
+        }
+        for (int level = 0; level < LEVELS; level++) {
+            int shift = BITS * (level + 1);
+            if ((timer.due >> shift) == (current >> shift)) {
+                int slot = (timer.due >> (BITS * level)) & (SLOTS - 1);
+                slots[level][slot].push_back(move(timer));
+                occupied[level] |= uint64_t(1) << slot;
+                return;
+            }
+        }
+        overflow.push_back(move(timer));
+    }
+
+    // takes out a slot's timers; they go back in with place() or fire
+    vector<Timer> take(int level, int slot) {
+        vector<Timer> timers;
+        timers.swap(slots[level][slot]);
+        occupied[level] &= ~(uint64_t(1) << slot);
+        return timers;
+    }
+
+public:
+    explicit TimingWheel(int64_t now) : current(now) {}
+
+    size_t size() const {
+        return count;
+    }
+
+    // payload fires on the first advance to due or later
+    void add(int64_t due, T payload) {
+        count++;
+        place(Timer{due, move(payload)});
+    }
+
+    // Fires every timer due by now, tick by tick; ones added already overdue go first.
+    // fire(payload) may add timers.
+    template <typename F>
+    void advance(int64_t now, F fire) {
+        vector<Timer> late;
+        late.swap(overdue);
+        for (Timer& timer : late) {
+            count--;
+            fire(timer.payload);
+        }
+        while (current < now && count > overdue.size()) {
+            // jump to the next block boundary when the levels below it are empty
+            int empty_levels = 0;
+            while (empty_levels < LEVELS && occupied[empty_levels] == 0) {
+                empty_levels++;
+            }
+            if (empty_levels > 0) {
+                int64_t block = int64_t(1) << (BITS * empty_levels);
+                int64_t boundary = (current / block + 1) * block;
+                if (boundary > now) {
+                    break;
+                }
+                current = boundary - 1;
+            }
+            int64_t tick = ++current;
+            if (tick % (int64_t(1) << (BITS * LEVELS)) == 0) {
+                vector<Timer> far;
+                far.swap(overflow);
+                for (Timer& timer : far) {
+                    place(move(timer));
+                }
+            }
+            for (int level = LEVELS - 1; level > 0; level--) {
+                if (tick % (int64_t(1) << (BITS * level)) == 0) {
+                    for (Timer& timer : take(level, (tick >> (BITS * level)) & (SLOTS - 1))) {
+                        place(move(timer));
+                    }
+                }
+            }
+            for (Timer& timer : take(0, tick & (SLOTS - 1))) {
+                count--;
+                fire(timer.payload);
+            }
+        }
+        current = max(current, now);
+        while (!overdue.empty()) { // added by fire() with deadlines already passed
+            late.clear();
+            late.swap(overdue);
+            for (Timer& timer : late) {
+                count--;
+                fire(timer.payload);
+            }
+        }
+    }
+};
+
+#endif // TIMING_WHEEL_HPP
@@ -5,6 +5,9 @@
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include "ticket.hpp"
 
 using namespace std;
@@ -15,20 +18,52 @@ enum USER_TYPE {
     NON_RESIDENT = 2
 };
 
+// the USER_TYPE for a number typed in, sent or read from a file; anything that
+// is not a type is a non-resident, so Pricing only ever sees a real one
+inline USER_TYPE to_user_type(int value) {
+    return value == CITY || value == RESIDENT ? static_cast<USER_TYPE>(value) : NON_RESIDENT;
+}
+
+// a user's place in the UserRegistry, valid for as long as the registry
+typedef uint32_t UserHandle;
+static const UserHandle NO_USER = UINT32_MAX;
+
 class User {
     string name;
-    double bank_balance;
+    atomic<double> bank_balance{0}; // read without the System lock, see UserRegistry
     USER_TYPE user_type;
     vector<Ticket> tickets_owned;
+    bool tickets_pending = false; // see defer_tickets
+    UserHandle handle = NO_USER;
 
 public:
     User() {}
-    User(const string& name, int balance, USER_TYPE type) : name(name), bank_balance(balance), user_type(type) {
-        vector<Ticket> tickets;
+    User(string name, double balance, USER_TYPE type) : name(move(name)), bank_balance(balance), user_type(type) {}
+
+    User(const User& other)
+        : name(other.name), bank_balance(other.get_bank_balance()), user_type(other.user_type),
+          tickets_owned(other.tickets_owned), tickets_pending(other.tickets_pending), handle(other.handle) {}
+
+    User& operator=(const User& other) {
+        name = other.name;
+        bank_balance.store(other.get_bank_balance(), memory_order_relaxed);
+        user_type = other.user_type;
+        tickets_owned = other.tickets_owned;
+        tickets_pending = other.tickets_pending;
+        handle = other.handle;
+        return *this;
+    }
+
+    UserHandle get_handle() const {
+        return handle;
+    }
+
+    void set_handle(UserHandle h) {
+        handle = h;
     }
 
     //Standard getter and setters
-    string get_user_name() const {
+    const string& get_user_name() const {
         return name;
     }
 
@@ -37,11 +72,11 @@ public:
     }
 
     double get_bank_balance() const {
-        return bank_balance;
+        return bank_balance.load(memory_order_relaxed);
     }
 
     void set_bank_balance(double balance) {
-        bank_balance = balance;
+        bank_balance.store(balance, memory_order_relaxed);
     }
 
     USER_TYPE get_user_type() const {
@@ -52,22 +87,41 @@ public:
         user_type = type;
     }
 
-    vector<Ticket> get_tickets() {
+    const vector<Ticket>& get_tickets() const {
         return tickets_owned;
     }
 
+    // A loaded user's tickets are worked out from the events when first needed and handed
+    // over with set_tickets. Until then changes to them are no-ops: the events have them.
+    void defer_tickets() {
+        tickets_pending = true;
+    }
+
+    bool tickets_loaded() const {
+        return !tickets_pending;
+    }
+
+    void set_tickets(vector<Ticket> tickets) {
+        tickets_owned = move(tickets);
+        tickets_pending = false;
+    }
+
     void add_ticket(Ticket ticket) {
-        tickets_owned.push_back(ticket);
+        if (!tickets_pending) {
+            tickets_owned.push_back(move(ticket));
+        }
     }
 
     void get_payment(double amount) {
-        bank_balance += amount;
+        double balance = get_bank_balance();
+        while (!bank_balance.compare_exchange_weak(balance, balance + amount, memory_order_relaxed)) {
+        }
     }
     
     //cancel ticket logic
     void cancel_ticket(const string& event_name) {
         for (auto it = tickets_owned.begin(); it != tickets_owned.end(); ) {
-            if (it->get_owner() == name) {
+            if (it->get_event_name() == event_name) {
                 cout << "found the ticket\n";
                 tickets_owned.erase(it);
                 return; 
@@ -77,6 +131,12 @@ public:
         }
     }
 
+    // drops every ticket held for an event in one pass
+    void remove_tickets_for(const string& event_name) {
+        tickets_owned.erase(remove_if(tickets_owned.begin(), tickets_owned.end(),
+            [&](const Ticket& t) { return t.get_event_name() == event_name; }), tickets_owned.end());
+    }
+
     //logic to print all tickets you own for an event, inclduing duplicates
     void print_tickets() {
         for (auto& ticket : tickets_owned) {
@@ -0,0 +1,124 @@
+#ifndef USER_REGISTRY_HPP
+#define USER_REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include "user.hpp"
+
+using namespace std;
+
+// Every user, by name and by handle. Names hash to one of 16 shards, each a
+// map to handles behind its own reader-writer lock, so logins only contend
+// when they land on the same shard and only with a creation there. Users live
+// in chunks that are never moved or freed while the registry lives, so a
+// handle, or a User* taken from one, stays valid through any number of
+// inserts; going from handle to User takes no lock at all. Users are never
+// removed. Lookups and creation are thread safe; changing a user is up to the
+// caller, except for the balance, which is atomic.
+class UserRegistry {
+    static const int SHARDS = 16;
+    static const int CHUNK_BITS = 10; // 1024 users a chunk
+    static const uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+    static const uint32_t MAX_CHUNKS = 1u << 14; // 16M users
+
+    struct alignas(64) Shard {
+        mutable shared_mutex lock;
+        unordered_map<string, UserHandle> handles;
+    };
+
+    Shard shards[SHARDS];
+    unique_ptr<atomic<User*>[]> chunks;
+    atomic<uint32_t> count{0}; // handles below this are published
+    mutex grow_lock;           // taken after a shard's lock, never before
+
+    Shard& shard_of(const string& name) {
+        return shards[hash<string>()(name) % SHARDS];
+    }
+
+    const Shard& shard_of(const string& name) const {
+        return shards[hash<string>()(name) % SHARDS];
+    }
+
+public:
+    UserRegistry() : chunks(new atomic<User*>[MAX_CHUNKS]) {
+        for (uint32_t i = 0; i < MAX_CHUNKS; i++) {
+            chunks[i].store(nullptr, memory_order_relaxed);
+        }
+    }
+
+    ~UserRegistry() {
+        for (uint32_t i = 0; i < MAX_CHUNKS && chunks[i].load(); i++) {
+            delete[] chunks[i].load();
+        }
+    }
+
+    UserRegistry(const UserRegistry&) = delete;
+    UserRegistry& operator=(const UserRegistry&) = delete;
+
+    // handles run from 0 to size() - 1 in the order the users were created
+    size_t size() const {
+        return count.load(memory_order_acquire);
+    }
+
+    User* get(UserHandle handle) const {
+        return &chunks[handle >> CHUNK_BITS].load(memory_order_acquire)[handle & (CHUNK_SIZE - 1)];
+    }
+
+    UserHandle handle_of(const string& name) const {
+        const Shard& shard = shard_of(name);
+        shared_lock<shared_mutex> guard(shard.lock);
+        auto it = shard.handles.find(name);
+        return it == shard.handles.end() ? NO_USER : it->second;
+    }
+
+    // nullptr if there is no such user
+    User* find(const string& name) const {
+        UserHandle handle = handle_of(name);
+        return handle == NO_USER ? nullptr : get(handle);
+    }
+
+    // Adds a user unless the name is taken; returns the user of that name and whether
+    // it is the one just added.
+    pair<User*, bool> create(const string& name, double balance, USER_TYPE type) {
+        Shard& shard = shard_of(name);
+        unique_lock<shared_mutex> guard(shard.lock);
+        auto it = shard.handles.find(name);
+        if (it != shard.handles.end()) {
+            return {get(it->second), false};
+        }
+        lock_guard<mutex> grow(grow_lock);
+        UserHandle handle = count.load(memory_order_relaxed);
+        if (handle >= MAX_CHUNKS * CHUNK_SIZE) {
+            throw length_error("user registry is full");
+        }
+        if ((handle & (CHUNK_SIZE - 1)) == 0) {
+            chunks[handle >> CHUNK_BITS].store(new User[CHUNK_SIZE], memory_order_release);
+        }
+        User* user = get(handle);
+        *user = User(name, balance, type);
+        user->set_handle(handle);
+        shard.handles.emplace(name, handle);
+        count.store(handle + 1, memory_order_release);
+        return {user, true};
+    }
+
+    // every user, sorted by name
+    vector<User*> by_name() const {
+        vector<User*> users;
+        users.reserve(size());
+        for (UserHandle handle = 0; handle < size(); handle++) {
+            users.push_back(get(handle));
+        }
+        sort(users.begin(), users.end(), [](const User* a, const User* b) { return a->get_user_name() < b->get_user_name(); });
+        return users;
+    }
+};
+
+#endif // USER_REGISTRY_HPP
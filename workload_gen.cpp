@@ -0,0 +1,121 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <ctime>
+#include <sys/stat.h>
+#include "calendar.hpp"
+#include "seat_map.hpp"
+
+using namespace std;
+
+// Generates a synthetic data set in the same formats System loads:
+// users.csv, events_data.csv, facility_budget.txt and waitlist/waitlist_<event>.csv
+//
+// usage: ./workload_gen <out_dir> [users] [events] [seed]
+
+struct GenUser {
+    string name;
+    int balance;
+    int type; // USER_TYPE
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <out_dir> [users] [events] [seed]\n";
+        return 1;
+    }
+    string out_dir = argv[1];
+    int num_users = argc > 2 ? stoi(argv[2]) : 1000;
+    int num_events = argc > 3 ? stoi(argv[3]) : 2000;
+    unsigned seed = argc > 4 ? stoul(argv[4]) : 42;
+
+    mkdir(out_dir.c_str(), 0755);
+    mkdir((out_dir + "/waitlist").c_str(), 0755);
+    mt19937 rng(seed);
+    auto chance = [&](int percent) { return (int)(rng() % 100) < percent; };
+
+    // users: mostly residents, some non-residents and a few city workers
+    vector<GenUser> users;
+    ofstream users_file(out_dir + "/users.csv");
+    for (int i = 0; i < num_users; i++) {
+        int roll = rng() % 100;
+        int type = roll < 5 ? 0 : (roll < 70 ? 1 : 2);
+        GenUser u{"user" + to_string(i), 50 + (int)(rng() % 5000), type};
+        users.push_back(u);
+        users_file << u.name << ',' << u.balance << ',' << u.type << '\n';
+    }
+
+    // events are laid out back to back in the single room, between 9 AM and 9 PM local time
+    int64_t day = Calendar::local_day(time(nullptr)) + 1;
+    int hour = 9;
+
+    ofstream events_file(out_dir + "/events_data.csv");
+    long long budget = 0;
+    int tickets_sold = 0, waitlisted = 0;
+    for (int i = 0; i < num_events; i++) {
+        int duration = 1 + rng() % 4;
+        if (hour + duration > 20) { // move on to the next day
+            day++;
+            hour = 9;
+        }
+        CivilTime date;
+        Calendar::civil_from_days(day, date.year, date.month, date.day);
+        time_t start = Calendar::to_utc(date.year, date.month, date.day, hour);
+        time_t end = start + duration * 3600;
+        hour += duration + rng() % 2;
+
+        const GenUser& creator = users[rng() % users.size()];
+        int price_per_hour = creator.type == 0 ? 5 : (creator.type == 1 ? 10 : 15);
+        bool pubpriv = chance(70);
+        bool open_to_non = chance(60);
+        int style = rng() % 4;
+        if (creator.type == 0 && style == 2) {
+            style = 0; // city cannot book weddings
+        }
+        bool confirmed = chance(80);
+        int cost_to_attend = pubpriv ? 5 + rng() % 46 : 0;
+        string name = "Event " + to_string(i);
+        if (confirmed) {
+            budget += price_per_hour * duration + 10;
+        }
+
+        events_file << name << ',' << creator.name << ',' << start << ',' << end << ','
+            << price_per_hour << ',' << pubpriv << ',' << open_to_non << ',' << style << ','
+            << confirmed << ',' << cost_to_attend;
+
+        bool sold_out = false;
+        if (pubpriv) {
+            // one ticket per seat, sold front to back
+            int capacity = SeatLayout::of(style).get_capacity();
+            int sold = confirmed ? (chance(15) ? capacity : rng() % capacity) : 0;
+            sold_out = sold == capacity;
+            for (int t = 0; t < sold; t++) {
+                events_file << ',' << cost_to_attend << ',' << users[rng() % users.size()].name << ",1";
+            }
+            for (int t = sold; t < capacity; t++) {
+                events_file << ',' << cost_to_attend << ",,0";
+            }
+            tickets_sold += sold;
+        }
+        events_file << '\n';
+
+        // every event gets a waitlist file, only sold out ones have anybody on it
+        ofstream waitlist_file(out_dir + "/waitlist/waitlist_" + name + ".csv");
+        if (sold_out) {
+            int waiting = rng() % 10;
+            for (int w = 0; w < waiting; w++) {
+                waitlist_file << users[rng() % users.size()].name << '\n';
+            }
+            waitlisted += waiting;
+        }
+    }
+
+    ofstream budget_file(out_dir + "/facility_budget.txt");
+    budget_file << budget;
+
+    cout << "Wrote " << num_users << " users, " << num_events << " events, "
+        << tickets_sold << " sold tickets and " << waitlisted << " waitlist entries to " << out_dir << "\n";
+    return 0;
+}